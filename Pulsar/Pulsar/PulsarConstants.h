@@ -147,12 +147,44 @@ namespace cst
 
 
 
+  //! Default error bound of the barycentric correction table (in s.)
+
+  const double baryTableTol = 1e-8;
+
+
+
+  //! Largest and smallest node spacing of the barycentric correction table (in s.)
+
+  const double baryTableMaxStep = 3600.;
+
+  const double baryTableMinStep = 60.;
+
+
+
+  //! Number of nodes in each chunk of the barycentric correction table
+
+  const int baryTableChunk = 144;
+
+
+
   //! Tolerance for the inverse binary demodulation (in s.)
 
   const double InverseDemodTol = 5e-6;
 
 
 
+  //! Maximum number of Newton iterations in the phase-to-time inversion, before falling back to bisection
+
+  const int NextTimeMaxIter = 5;
+
+
+
+  //! Maximum number of iterations in the inversion of barycentric corrections and binary demodulation
+
+  const int InverseMaxIter = 20;
+
+
+
   //! Tolerance for the iterative binary demodulation
 
   const double DemodTol = 1e-8;
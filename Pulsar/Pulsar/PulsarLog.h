@@ -0,0 +1,82 @@
+/**
+ * @file PulsarLog.h
+ * @brief Class Header for PulsarLog.cxx
+ *
+ * $Header$
+ */
+#ifndef PulsarLog_H
+#define PulsarLog_H
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!
+ * \class PulsarLog
+ * \brief Log file of a pulsar source; the rows of columnar logs are written by a background thread.
+ *
+ * A text log collects messages, which are appended to the file as soon as they are written.
+ * A columnar log collects rows of a fixed number of values, e.g. the barycentric corrections of
+ * each photon. The rows are kept in a buffer, and a single thread shared by all the columnar logs
+ * formats them as tab-separated text lines and appends them to the file when the buffer fills up,
+ * at least once a second, and when the log is closed; if the program stops abnormally, only the
+ * rows of the last second are lost.
+ * If the PULSAR_LOG_BINARY environment variable is set, the rows are written instead in native
+ * binary form to a file with the extension .bin added, which can be converted with convertToText;
+ * the conversion skips a last incomplete row.
+ *
+ * The methods may be called from any thread.
+ */
+class PulsarLog
+{
+
+ public:
+
+  //! Open a log file; nColumns = 0 for a text log, otherwise the number of values in each row
+  PulsarLog(const std::string &fileName, int nColumns = 0, int precision = 20);
+
+  //! Write all the rows and close the file
+  ~PulsarLog();
+
+  //! Write text to a text log
+  void write(const std::string &text);
+
+  //! Write a row of nColumns values to a columnar log
+  void writeRow(const double *values);
+
+  //! Wait until all the data have been written to the file
+  void flush();
+
+  //! Append the rows of a binary file as tab-separated text lines
+  static void convertToText(const std::string &binFileName, const std::string &textFileName,
+			    int nColumns, int precision);
+
+ private:
+
+  //! Thread writing the rows of all the columnar logs
+  struct Writer;
+
+  //! Return the writer thread, starting it the first time
+  static Writer & writer();
+
+  //! Write rows to the file, as text or binary
+  void writeRows(const std::vector<double> &rows);
+
+  //! Write values as tab-separated text lines of nColumns values
+  static void writeText(std::ostream &out, const double *values, size_t nValues, int nColumns);
+
+  std::string m_fileName;
+  int m_nColumns;
+  bool m_binary;
+
+  std::ofstream m_file;
+
+  //! Protects the file of a text log
+  std::mutex m_mutex;
+
+  //! Rows waiting for the writer thread (protected by its mutex)
+  std::vector<double> m_rows;
+
+};
+#endif
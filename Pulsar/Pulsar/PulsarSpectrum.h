@@ -19,6 +19,8 @@
 #include <stdexcept>
 #include "PulsarConstants.h"
 #include "PulsarSim.h"
+#include "PulsarLog.h"
+#include "SolarSystemCache.h"
 #include "SpectObj/SpectObj.h"
 #include "flux/Spectrum.h"
 #include "CLHEP/Vector/ThreeVector.h"
@@ -73,6 +75,12 @@ class PulsarSpectrum : public Spectrum
 
   //!Apply the barycentric corrections and returns arrival time in TDB
   double getBaryCorr(double tdbInput, int LogCorrFlag);
+
+  //! Compute the barycentric corrections directly from the ephemerides, without the table
+  double getDirectBaryCorr(double ttInput, int LogCorrFlag);
+
+  //! Compute the Shapiro delay given the vector from the Earth to the Sun
+  double getShapiroDelay(const CLHEP::Hep3Vector &sunV);
  
   //! Compute binary demodulation in iterative way
   double getIterativeDemodulatedTime(double tInput, int LogFlag);
@@ -85,6 +93,9 @@ class PulsarSpectrum : public Spectrum
   //! Compute binary demodulation in a single step
   double getBinaryDemodulation( double tInput, int LogDemodFlag);
 
+  //! Compute the time derivative of the binary demodulation
+  double getBinaryDemodulationRate( double tInput);
+
   //! Get the decorrected time in TDB starting from a TT corrected time (inverse of getBaryCorr)
   double getDecorrectedTime( double CorrectedTime);
 
@@ -133,6 +144,15 @@ class PulsarSpectrum : public Spectrum
   //! Return the pulsar frequency first derivative at time t
   double GetF1t(double time, double myf1, double myf2);
 
+  //! Return the end of the spacecraft data (MET); no barycentric corrections are applied from 510 s before it
+  double getFT2StopTime() const {return m_FT2_stopMET;}
+
+  //! Return the number of calls to retrieveNextTimeTilde
+  long getNextTimeCalls() const {return m_nextTimeCalls;}
+
+  //! Return the number of calls to retrieveNextTimeTilde that fell back to bisection
+  long getNextTimeFallbacks() const {return m_nextTimeFallbacks;}
+
   //! direction, taken from PulsarSim
   inline std::pair<double,double>
     
@@ -252,5 +272,11 @@ class PulsarSpectrum : public Spectrum
   //! output log filename
   std::string m_LogFileName;
 
+  //! Buffered output log, and logs of barycentric corrections, binary demodulation and timing noise (0 if not requested)
+  PulsarLog *m_Log, *m_BaryCorrLog, *m_BinDemodLog, *m_TimingNoiseLog;
+
+  //! Number of calls to retrieveNextTimeTilde, and of those that fell back to bisection
+  long m_nextTimeCalls, m_nextTimeFallbacks;
+
 };
 #endif
@@ -0,0 +1,83 @@
+/**
+ * @file SolarSystemCache.h
+ * @brief Class Header for SolarSystemCache.cxx
+ *
+ * $Header$
+ */
+#ifndef SolarSystemCache_H
+#define SolarSystemCache_H
+
+#include <map>
+#include <vector>
+#include "PulsarConstants.h"
+#include "CLHEP/Vector/ThreeVector.h"
+#include "astro/JulianDate.h"
+#include "astro/EarthOrbit.h"
+#include "astro/SolarSystem.h"
+
+/*!
+ * \class SolarSystemCache
+ * \brief Table of the Solar System ephemerides used in the barycentric corrections, shared by all the PulsarSpectrum sources.
+ *
+ * The barycentric corrections of every pulsar need TDB-TT, the position of the Earth with respect to the Solar
+ * System barycenter and the vector from the Earth to the Sun at the photon arrival time. These do not depend on
+ * the pulsar, so they are tabulated once for all the sources, at nodes spaced uniformly in time, and interpolated
+ * with a cubic polynomial through the four nearest nodes. The table is built in chunks of baryTableChunk nodes,
+ * the first time a time in the chunk is requested.
+ *
+ * The node spacing is chosen when the table is first used, according to its error bound. This is baryTableTol,
+ * or the value of the PULSAR_BARY_TABLE_TOL environment variable (in s.); 0 disables the table.
+ * Like the sources that use it, the table is not thread-safe.
+ */
+class SolarSystemCache
+{
+
+ public:
+
+  //! Ephemerides at a given time: TDB-TT (s.), and Earth position and Sun direction (light-seconds)
+  struct Ephemeris
+  {
+    double tdbMinusTT;
+    CLHEP::Hep3Vector barycenter;
+    CLHEP::Hep3Vector solarVector;
+  };
+
+  //! Return the table shared by all sources, creating it the first time
+  static SolarSystemCache * instance();
+
+  ~SolarSystemCache();
+
+  //! Interpolate the ephemerides at a time in MET (TT); returns false if there is no table, or if the ephemerides do not cover the time
+  bool getEphemeris(double timeMET, Ephemeris &eph);
+
+  //! Compute the ephemerides directly at a time in MET (TT); throws astro::SolarSystem::BadDate if they are not available
+  Ephemeris computeEphemeris(double timeMET);
+
+  //! Return the node spacing of the table
+  double step() const {return m_step;}
+
+  //! Return the error bound of the table (0 if there is no table)
+  double tolerance() const {return m_tol;}
+
+ private:
+
+  SolarSystemCache();
+
+  //! Choose the node spacing of the table, starting at the time of the first request
+  void InitTable(double timeMET);
+
+  //! Number of values stored for each node
+  static const int s_nValues = 7;
+
+  astro::EarthOrbit *m_earthOrbit;
+  astro::SolarSystem m_solSys;
+
+  //! Values at the nodes, by chunks of baryTableChunk nodes
+  std::map<long, std::vector<double> > m_table;
+
+  //! Node spacing and error bound of the table
+  double m_step, m_tol;
+  bool m_initialized;
+
+};
+#endif
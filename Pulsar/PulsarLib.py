@@ -12,6 +12,8 @@ def generate(env, **kw):
     env.Tool('astroLib')
     env.Tool('addLibrary', library = env['rootLibs'])
     env.Tool('addLibrary', library = env['rootGuiLibs'])
+    if env['PLATFORM'] != 'win32':
+        env.Tool('addLibrary', library = ['pthread'])
     if kw.get('incsOnly', 0) == 1: 
         env.Tool('findPkgPath', package = 'SpectObj') 
         env.Tool('findPkgPath', package = 'flux') 
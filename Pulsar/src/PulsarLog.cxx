@@ -0,0 +1,222 @@
+/////////////////////////////////////////////////
+// File PulsarLog.cxx
+// Implementation of PulsarLog class
+//////////////////////////////////////////////////
+
+#include "Pulsar/PulsarLog.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iomanip>
+#include <set>
+#include <thread>
+
+namespace {
+  //! Buffer size (bytes) of a log at which its rows are written, and at which writing to the buffer waits
+  const size_t s_flushSize = 1 << 20;
+  const size_t s_maxBuffer = 16 << 20;
+}
+
+/////////////////////////////////////////////////
+/*!
+ * The thread wakes up at least once a second and writes the rows of every open columnar log.
+ * It is stopped when the program exits, after writing the rows of the logs still open.
+ */
+struct PulsarLog::Writer
+{
+  Writer() : busy(0), wake(false), stop(false)
+  {
+    thread = std::thread(&Writer::run, this);
+  }
+
+  ~Writer()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cond.notify_all();
+    thread.join();
+  }
+
+  void run();
+
+  //! Open columnar logs, and the one whose rows are being written
+  std::set<PulsarLog *> logs;
+  PulsarLog *busy;
+
+  bool wake, stop;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::thread thread;
+};
+
+/////////////////////////////////////////////////
+void PulsarLog::Writer::run()
+{
+  std::vector<double> rows;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+    {
+      cond.wait_for(lock, std::chrono::seconds(1), [this] { return stop || wake; });
+      bool last = stop;
+      wake = false;
+
+      std::vector<PulsarLog *> pending(logs.begin(), logs.end());
+      for (size_t i = 0; i < pending.size(); i++)
+	{
+	  PulsarLog *log = pending[i];
+	  if ((logs.count(log) == 0) || log->m_rows.empty())
+	    continue;
+	  busy = log;
+	  rows.swap(log->m_rows);
+
+	  //Write without holding the lock, so that the sources can go on filling their buffers
+	  lock.unlock();
+	  log->writeRows(rows);
+	  rows.clear();
+	  lock.lock();
+
+	  busy = 0;
+	  cond.notify_all();
+	}
+
+      if (last)
+	break;
+    }
+}
+
+/////////////////////////////////////////////////
+PulsarLog::Writer & PulsarLog::writer()
+{
+  static Writer s_writer;
+  return s_writer;
+}
+
+/////////////////////////////////////////////////
+/*!
+ * \param fileName Name of the log file
+ * \param nColumns Number of values in each row, or 0 for a text log
+ * \param precision Number of digits of the values in the text file
+ */
+PulsarLog::PulsarLog(const std::string &fileName, int nColumns, int precision)
+  : m_fileName(fileName), m_nColumns(nColumns),
+    m_binary((nColumns > 0) && (::getenv("PULSAR_LOG_BINARY") != 0))
+{
+  if (m_binary)
+    m_file.open((m_fileName + ".bin").c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  else
+    m_file.open(m_fileName.c_str(), std::ios::app);
+  m_file << std::setprecision(precision);
+
+  if (m_nColumns > 0)
+    {
+      Writer &w = writer();
+      std::lock_guard<std::mutex> lock(w.mutex);
+      w.logs.insert(this);
+    }
+}
+
+/////////////////////////////////////////////////
+PulsarLog::~PulsarLog()
+{
+  if (m_nColumns > 0)
+    {
+      Writer &w = writer();
+      std::vector<double> rows;
+      {
+	std::unique_lock<std::mutex> lock(w.mutex);
+	w.logs.erase(this);
+	w.cond.wait(lock, [this, &w] { return w.busy != this; });
+	rows.swap(m_rows);
+      }
+      writeRows(rows);
+    }
+  m_file.close();
+}
+
+/////////////////////////////////////////////////
+void PulsarLog::write(const std::string &text)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_file << text;
+  m_file.flush();
+}
+
+/////////////////////////////////////////////////
+void PulsarLog::writeRow(const double *values)
+{
+  Writer &w = writer();
+  std::unique_lock<std::mutex> lock(w.mutex);
+  w.cond.wait(lock, [this] { return m_rows.size()*sizeof(double) < s_maxBuffer; });
+  m_rows.insert(m_rows.end(), values, values + m_nColumns);
+  if (m_rows.size()*sizeof(double) >= s_flushSize)
+    {
+      w.wake = true;
+      w.cond.notify_all();
+    }
+}
+
+/////////////////////////////////////////////////
+void PulsarLog::flush()
+{
+  if (m_nColumns == 0)
+    return;
+
+  Writer &w = writer();
+  std::unique_lock<std::mutex> lock(w.mutex);
+  w.wake = true;
+  w.cond.notify_all();
+  w.cond.wait(lock, [this, &w] { return m_rows.empty() && (w.busy != this); });
+}
+
+/////////////////////////////////////////////////
+void PulsarLog::writeRows(const std::vector<double> &rows)
+{
+  if (rows.empty())
+    return;
+
+  if (m_binary)
+    m_file.write(reinterpret_cast<const char *>(&rows[0]), rows.size()*sizeof(double));
+  else
+    writeText(m_file, &rows[0], rows.size(), m_nColumns);
+  m_file.flush();
+}
+
+/////////////////////////////////////////////////
+/*!
+ * \param out Stream to which the lines are written, with its precision already set
+ * \param values Values of the rows, one after the other
+ * \param nValues Number of values (a multiple of nColumns)
+ * \param nColumns Number of values in each row
+ */
+void PulsarLog::writeText(std::ostream &out, const double *values, size_t nValues, int nColumns)
+{
+  for (size_t i = 0; i < nValues; i += nColumns)
+    {
+      out << values[i];
+      for (int j = 1; j < nColumns; j++)
+	out << "\t" << values[i+j];
+      out << "\n";
+    }
+}
+
+/////////////////////////////////////////////////
+/*!
+ * \param binFileName Name of the binary file
+ * \param textFileName Name of the text file, to which the lines are appended
+ * \param nColumns Number of values in each row
+ * \param precision Number of digits of the values
+ */
+void PulsarLog::convertToText(const std::string &binFileName, const std::string &textFileName,
+			      int nColumns, int precision)
+{
+  std::ifstream BinFile(binFileName.c_str(), std::ios::in | std::ios::binary);
+  std::ofstream TextFile(textFileName.c_str(), std::ios::app);
+  TextFile << std::setprecision(precision);
+
+  std::vector<double> row(nColumns);
+  while (BinFile.read(reinterpret_cast<char *>(&row[0]), nColumns*sizeof(double)))
+    writeText(TextFile, &row[0], nColumns, nColumns);
+  TextFile.close();
+}
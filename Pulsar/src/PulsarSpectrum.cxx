@@ -9,6 +9,7 @@
 #include "flux/SpectrumFactory.h"
 #include "facilities/commonUtilities.h"
 #include "facilities/Util.h"
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <vector>
@@ -151,6 +152,14 @@ PulsarSpectrum::PulsarSpectrum(const std::string& params)
 
   m_UseFT2 = 0;
 
+  m_nextTimeCalls = 0;
+  m_nextTimeFallbacks = 0;
+
+  m_Log = 0;
+  m_BaryCorrLog = 0;
+  m_BinDemodLog = 0;
+  m_TimingNoiseLog = 0;
+
   //Read from XML file
   m_PSRname    = parseParamList(params,0).c_str();            // Pulsar name
   m_RA = std::atof(parseParamList(params,1).c_str());         // Pulsar Right Ascension
@@ -271,6 +280,16 @@ PulsarSpectrum::PulsarSpectrum(const std::string& params)
       InitTimingNoise();
     }
 
+  //Open the requested logs, after their headers have been written
+  if (::getenv("PULSAR_OUT_BARY"))
+    m_BaryCorrLog = new PulsarLog(m_PSRname + "BaryCorr.log", 7, 20);
+
+  if ((m_BinaryFlag ==1) && (::getenv("PULSAR_OUT_BIN")))
+    m_BinDemodLog = new PulsarLog(m_PSRname + "BinDemod.log", 10, 15);
+
+  if ((m_TimingNoiseModel != 0) && (::getenv("PULSAR_OUT_TNOISE")))
+    m_TimingNoiseLog = new PulsarLog(m_PSRname + "TimingNoise.log", 13, 30);
+
   //Instantiate an object of PulsarSim class
   m_Pulsar    = new PulsarSim(m_PSRname, m_seed, m_flux, m_enphmin, m_enphmax, m_period);
  
@@ -305,6 +324,8 @@ PulsarSpectrum::PulsarSpectrum(const std::string& params)
       else
 	m_LogFileName = m_PSRname + "Log.txt";
 
+      m_Log = new PulsarLog(m_LogFileName);
+
       char temp[200];
       sprintf(temp,"**  Output Level set to: %d",m_OutputLevel);
       WriteToLog(std::string(temp));
@@ -321,6 +342,18 @@ PulsarSpectrum::PulsarSpectrum(const std::string& params)
 /////////////////////////////////////////////////
 PulsarSpectrum::~PulsarSpectrum() 
 {  
+  if ((m_OutputLevel > 0) && (m_nextTimeCalls > 0))
+    {
+      char temp[200];
+      sprintf(temp,"Next photon time found by bisection in %ld of %ld cases",m_nextTimeFallbacks,m_nextTimeCalls);
+      WriteToLog(std::string(temp));
+    }
+
+  delete m_Log;
+  delete m_BaryCorrLog;
+  delete m_BinDemodLog;
+  delete m_TimingNoiseLog;
+
   delete m_Pulsar;
   delete m_spectrum;
   delete m_earthOrbit;
@@ -555,9 +588,37 @@ double PulsarSpectrum::getTurns( double time )
  *
  * <br>In this method a recursive way is used to find the <i>nextTime</i>. Starting at <i>tTilde</i>, the method returns 
  * nextTime, the time where the number of turns completed by the pulsar is equal to totalTurns (within the choosen tolerance).  
+ * <br>Since f<sub>2</sub> is small, the time is first found by solving the quadratic expansion of the turns about 
+ * <i>tTilde</i>, and then refined with Newton's method, which usually converges in one or two steps. 
+ * Only if this fails the time is found by bisection; the number of such cases is written to the log.
  */
 double PulsarSpectrum::retrieveNextTimeTilde( double tTilde, double totalTurns, double err )
 {
+  m_nextTimeCalls++;
+
+  //Quadratic expansion about tTilde: dN = F0*tau + F1*tau^2/2, solved in the form stable for small F1
+  double F0 = GetFt(tTilde,m_f0,m_f1,m_f2);
+  double F1 = GetF1t(tTilde,m_f1,m_f2);
+  double dN = totalTurns - getTurns(tTilde);
+  double disc = F0*F0 + 2.*F1*dN;
+
+  if ((F0 != 0.) && (disc >= 0.))
+    {
+      double sgn = ((F0 >= 0) ? 1 : -1);
+      double tNext = tTilde + 2.*dN/(F0 + sgn*std::sqrt(disc));
+      double NTnext = totalTurns - getTurns(tNext);
+      int nNewton = 0;
+      while ((fabs(NTnext) > err) && (nNewton < NextTimeMaxIter))
+	{
+	  tNext = tNext + NTnext/GetFt(tNext,m_f0,m_f1,m_f2);
+	  NTnext = totalTurns - getTurns(tNext);
+	  nNewton++;
+	}
+      if (fabs(NTnext) <= err)
+	return tNext;
+    }
+
+  m_nextTimeFallbacks++;
 
   double tTildeUp,NTup = 0.;
   double tTildeDown,NTdown = 0;  
@@ -625,6 +686,9 @@ double PulsarSpectrum::retrieveNextTimeTilde( double tTilde, double totalTurns,
  *  <li> Geometric Time Delay due to light propagation in Solar System;
  *  <li> Relativistic Shapiro delay;
  * </ul>   
+ * The Solar System ephemerides (TDB-TT, Earth position and Sun direction) change slowly, so they are interpolated
+ * from a table shared by all the pulsars (see SolarSystemCache); only the spacecraft position is taken from
+ * astro::GPS at each call. When the log is written, all the corrections are computed directly.
  */
 double PulsarSpectrum::getBaryCorr( double ttInput, int LogCorrFlag)
 {
@@ -640,6 +704,41 @@ double PulsarSpectrum::getBaryCorr( double ttInput, int LogCorrFlag)
       return 0.;
     }
 
+  double timeMET = ttInput - (StartMissionDateMJD)*SecsOneDay;
+  SolarSystemCache::Ephemeris eph;
+
+  if ((LogCorrFlag == 1) || !SolarSystemCache::instance()->getEphemeris(timeMET, eph))
+    {
+      return getDirectBaryCorr(ttInput, LogCorrFlag);
+    }
+
+  CLHEP::Hep3Vector scPos;
+  try {
+    astro::GPS::instance()->time(timeMET);
+    scPos = astro::GPS::instance()->position(timeMET);
+  } catch (astro::PointingHistory::TimeRangeError & )
+    {
+      if ((timeMET+510)>=m_FT2_stopMET)
+	{
+	  return 0.;
+	}
+    }
+
+  CLHEP::Hep3Vector GeomVect = (scPos/clight) - eph.barycenter;
+
+  return eph.tdbMinusTT + GeomVect.dot(m_PulsarVectDir) + getShapiroDelay(eph.solarVector); //seconds
+}
+
+/////////////////////////////////////////////
+/*!
+ * \param ttInput Photon arrival time at spacecraft in Terrestrial Time (expressed in MJD converted in seconds)
+ * \param LogCorrFlag Flag for writing output
+ *
+ * <br>
+ * This method computes the barycentric corrections of getBaryCorr directly from the ephemerides.
+ */
+double PulsarSpectrum::getDirectBaryCorr( double ttInput, int LogCorrFlag)
+{
 
   //Start Date;
   astro::JulianDate ttJD(StartMissionDateMJD+JDminusMJD);
@@ -697,11 +796,7 @@ double PulsarSpectrum::getBaryCorr( double ttInput, int LogCorrFlag)
 
   //Correction due to Shapiro delay.
   CLHEP::Hep3Vector sunV = m_solSys.getSolarVector(ttJD);
-
-  // Angle of source-sun-observer
-  double costheta = - sunV.dot(m_PulsarVectDir) / ( sunV.mag() * m_PulsarVectDir.mag() );
-  double m = 4.9271e-6; // m = G * Msun / c^3
-  double ShapiroCorr = 2.0 * m * log(1+costheta);
+  double ShapiroCorr = getShapiroDelay(sunV);
   if (DEBUG)
     {
       std::cout << std::setprecision(20) << "** --> TDB-TT = " << tdb_min_tt << std::endl;
@@ -721,17 +816,32 @@ double PulsarSpectrum::getBaryCorr( double ttInput, int LogCorrFlag)
 
 
 
-	  std::ofstream BaryCorrLogFile((m_PSRname + "BaryCorr.log").c_str(),std::ios::app);
-	  BaryCorrLogFile << std::setprecision(20)
-			  << timeMET << "\t" <<  PhaseOut << "\t" << GLASTPosGeom << "\t"<< EarthPosGeom << "\t" 
-			  << GeomCorr << "\t" << tdb_min_tt << "\t" << ShapiroCorr << std::endl;
-	  BaryCorrLogFile.close();
+	  if (m_BaryCorrLog)
+	    {
+	      double row[7] = {timeMET, PhaseOut, GLASTPosGeom, EarthPosGeom, GeomCorr, tdb_min_tt, ShapiroCorr};
+	      m_BaryCorrLog->writeRow(row);
+	    }
     }
 
   return tdb_min_tt + GeomCorr + ShapiroCorr; //seconds
   
 }
 
+/////////////////////////////////////////////
+/*!
+ * \param sunV Vector from the Earth to the Sun
+ *
+ * <br>
+ * This method computes the relativistic Shapiro delay due to the Sun.
+ */
+double PulsarSpectrum::getShapiroDelay(const CLHEP::Hep3Vector &sunV)
+{
+  // Angle of source-sun-observer
+  double costheta = - sunV.dot(m_PulsarVectDir) / ( sunV.mag() * m_PulsarVectDir.mag() );
+  double m = 4.9271e-6; // m = G * Msun / c^3
+  return 2.0 * m * log(1+costheta);
+}
+
 /////////////////////////////////////////////
 /*!
  * \param tInput Photon arrival time do be demodulated
@@ -892,28 +1002,78 @@ double PulsarSpectrum::getBinaryDemodulation( double tInput, int LogDemodFlag)
   
   if ((LogDemodFlag==1) && (tInput-StartMissionDateMJD*SecsOneDay > 0.))
     {
-      std::ofstream BinDemodLogFile((m_PSRname + "BinDemod.log").c_str(),std::ios::app);
-      BinDemodLogFile << std::setprecision(15) 
-		      << tInput-StartMissionDateMJD*SecsOneDay << "\t" << tInput - m_t0PeriastrMJD*SecsOneDay << "\t"
-		      << EccentricAnomaly << "\t" << TrueAnomaly << "\t"
-		      << Omega << "\t" << m_ecc << "\t" << asini << "\t"
-		      << BinaryRoemerDelay << "\t" 
-		      << BinaryEinsteinDelay << "\t" 
-		      << BinaryShapiroDelay << "\t" << std::endl;
-      BinDemodLogFile.close();
+      if (m_BinDemodLog)
+	{
+	  double row[10] = {tInput-StartMissionDateMJD*SecsOneDay, tInput - m_t0PeriastrMJD*SecsOneDay,
+			    EccentricAnomaly, TrueAnomaly, Omega, m_ecc, asini,
+			    BinaryRoemerDelay, BinaryEinsteinDelay, BinaryShapiroDelay};
+	  m_BinDemodLog->writeRow(row);
+	}
     }
 
   return -1.*(BinaryRoemerDelay+BinaryEinsteinDelay+BinaryShapiroDelay);
 }
 
+/////////////////////////////////////////////
+/*!
+ * \param tInput Photon arrival time do be demodulated
+ *
+ * <br>
+ * This method returns the time derivative of getBinaryDemodulation, i.e. minus the rate of change
+ * of the Roemer, Einstein and Shapiro delays along the orbit. The small term due to the second derivative
+ * of the mean anomaly is neglected.
+ */
+double PulsarSpectrum::getBinaryDemodulationRate( double tInput)
+{
+  double dt = tInput-m_t0PeriastrMJD*SecsOneDay;
+  double OmegaMean = 2*M_PI/m_Porb;
+  double EccAnConst = OmegaMean*(dt - 0.5*(dt*dt*(m_Porb_dot/m_Porb)));
+
+  double EccentricAnomaly = 0.; 
+  int status = atKepler(EccAnConst, m_ecc, &EccentricAnomaly); //AtKepler
+  if (0 != status) {
+     throw std::runtime_error("atKepler did not converge.");
+  } 
+
+  double TrueAnomaly = 2.0 * std::atan(std::sqrt((1.0+m_ecc)/(1.0-m_ecc))*std::tan(EccentricAnomaly*0.5));
+  TrueAnomaly = TrueAnomaly + 2*M_PI*floor((EccentricAnomaly - TrueAnomaly)/ (2*M_PI));
+  while ((TrueAnomaly - EccentricAnomaly) > M_PI) TrueAnomaly -= 2*M_PI;
+  while ((EccentricAnomaly - TrueAnomaly) > M_PI) TrueAnomaly += 2*M_PI;
+
+  double Omega = DegToRad*m_omega + DegToRad*m_omega_dot*(TrueAnomaly/OmegaMean);
+  double asini = m_asini + m_xdot*dt;
+
+  //Rates of change of the eccentric anomaly, from Kepler equation, and of the longitude of periastron
+  double cosE = std::cos(EccentricAnomaly);
+  double sinE = std::sin(EccentricAnomaly);
+  double EccAnRate = OmegaMean*(1. - dt*m_Porb_dot/m_Porb)/(1. - m_ecc*cosE);
+  double OmegaRate = DegToRad*m_omega_dot/OmegaMean*std::sqrt(1-m_ecc*m_ecc)/(1. - m_ecc*cosE)*EccAnRate;
+
+  //Roemer delay (in units of asini) and its derivative
+  double Roemer = (cosE-m_ecc)*std::sin(Omega) + sinE*std::cos(Omega)*std::sqrt(1-m_ecc*m_ecc);
+  double RoemerDer = (-sinE*std::sin(Omega) + cosE*std::cos(Omega)*std::sqrt(1-m_ecc*m_ecc))*EccAnRate
+    + ((cosE-m_ecc)*std::cos(Omega) - sinE*std::sin(Omega)*std::sqrt(1-m_ecc*m_ecc))*OmegaRate;
+
+  double BinaryRoemerRate = asini*RoemerDer + m_xdot*Roemer;
+  double BinaryEinsteinRate = m_gamma*cosE*EccAnRate;
+  double BinaryShapiroRate = -2.0*m_shapiro_r*(m_ecc*sinE*EccAnRate - m_shapiro_s*RoemerDer)
+    /(1.-m_ecc*cosE-m_shapiro_s*Roemer);
+
+  return -1.*(BinaryRoemerRate+BinaryEinsteinRate+BinaryShapiroRate);
+}
+
 /////////////////////////////////////////////
 /*!
  * \param CorrectedTime Photon arrival time at SSB (TDB expressed in MJD)
  *
  * <br>
  * This method returns the correspondent decorrected time starting from a photon arrival time
- * at the Solar System barycenter expressed in Barycentric Dynamical Time. This function uses the bisection method
- * for inverting barycentric corrections <br>
+ * at the Solar System barycenter expressed in Barycentric Dynamical Time. This function uses the secant method
+ * for inverting barycentric corrections: since the corrections change by less than 1e-4 s per second, the first
+ * step assumes a unit slope, and the following ones use the slope between the last two steps, unless it is far
+ * from unity (e.g. at the end of the FT2 file, where the corrections drop to zero). The search starts at most at the
+ * last time with corrections, so that a time just after the end of the FT2 file is matched to the corrected
+ * arrival time before the end, if there is one.<br>
  * The corrections implemented at the moment are:
  * <ul>
  *  <li> Conversion from TT to TDB;
@@ -923,85 +1083,33 @@ double PulsarSpectrum::getBinaryDemodulation( double tInput, int LogDemodFlag)
  */
 double PulsarSpectrum::getDecorrectedTime(double CorrectedTime)
 {
-  //  double CorrectedTime = 54.2342.;
-  double deltaT = 510.;
+  double tprev = std::min(CorrectedTime,(StartMissionDateMJD)*SecsOneDay+m_FT2_stopMET-510.);
+  double fprev = tprev + getBaryCorr(tprev,0) - CorrectedTime;
 
-  double tcurr = CorrectedTime-deltaT;
-  double fcurr = tcurr + getBaryCorr(tcurr,0); // fx(tcurr);
-  //  double fcurr_ct = CorrectedTime;
+  double tcurr = tprev - fprev;
+  double fcurr = tcurr + getBaryCorr(tcurr,0) - CorrectedTime;
 
-  if (DEBUG)
+  int nIterations = 1;
+  while ((fabs(fcurr) > baryCorrTol) && (nIterations < InverseMaxIter))
     {
-      std::cout << "Get decorrected time from time t=" << CorrectedTime << std::endl;
-    }
-
-  //double deltaStep = 10.;
-  int s = 0;
-  int SignDirection = 0;
+      double slope = (fcurr - fprev)/(tcurr - tprev);
+      if (!((slope > 0.5) && (slope < 2.)))
+	slope = 1.;
 
-  //std::cout << "\n\n***\ntstart= " << tcurr << " -->fcurr= " << fcurr 
-  //    << " -->fcurr_CT= " << fcurr_ct << " inital delta=" << deltaStep << std::endl;
-
-  if (CorrectedTime <= fcurr) // function increasing
-    {
-      //      std::cout << "Case 1: de-crescent function" << std::endl;
-      SignDirection = 1;
+      tprev = tcurr;
+      fprev = fcurr;
+      tcurr = tcurr - fcurr/slope;
+      fcurr = tcurr + getBaryCorr(tcurr,0) - CorrectedTime;
+      nIterations++;
     }
-  else
+
+  if (DEBUG)
     {
-      //std::cout << "Case 2: crescent function" << std::endl;
-      SignDirection = 2;
+      std::cout << std::setprecision(30) << "Decorrected time for t=" << CorrectedTime << " is " << tcurr
+		<< " after " << nIterations << " iterations; df=" << fcurr << std::endl;
     }
 
-  double deltaStep =  pow(10.,(2.-s));
-
-      while ( fabs(CorrectedTime-fcurr) > baryCorrTol)
-	{
-
-	  if (SignDirection == 1)
-	    {
-	      while (fcurr > CorrectedTime)
-		{ 
-		  tcurr = tcurr+deltaStep;
-		  fcurr = tcurr + getBaryCorr(tcurr,0); //fx(tcurr);
-		  //      std::cout << std::setprecision(30) << " tcurr=>" << tcurr << " fcurr " << fcurr 
-		  //	<< "df=" << CorrectedTime-fcurr << std::endl; 
-		}
-	    }
-	  else
-	    while (fcurr < CorrectedTime)
-	      { 
-		tcurr = tcurr+deltaStep;
-		fcurr = tcurr + getBaryCorr(tcurr,0); //fx(tcurr);
-		//std::cout << std::setprecision(30) << " tcurr=>" << tcurr << " fcurr " << fcurr 
-		//  << "df=" << CorrectedTime-fcurr << std::endl; 
-	      }
-	    
-	  
-	  tcurr = tcurr-deltaStep;
-	  fcurr = tcurr + getBaryCorr(tcurr,0); //fx(tcurr);
-	  s++;
-	  deltaStep =  pow(10.,(2.-s));
-	  //std::cout << "\n" << m_PSRname << "  Target superated, decreasing to " << deltaStep 
-	  //    << " and starting again1 from " << tcurr << std::endl;
-	  //std::cout << std::setprecision(30) << CorrectedTime << 
-	  //" <--" << fcurr << " df=" << CorrectedTime-fcurr << std::endl;
-	  if ((s > 10) || (deltaStep < 1e-7))
-	    {
-	      //std::cout << "Skipping ! " << std::endl;
-	      break;
-	    }
-	}
-
-      if (DEBUG)
-	{
-	  std::cout << std::setprecision(30) <<  s << " -> " << CorrectedTime 
-		    << " <--" << fcurr 
-		    << " df=" << CorrectedTime-fcurr << std::endl;
-	}
-
-
-      return tcurr;
+  return tcurr;
 }
 
 /////////////////////////////////////////////
@@ -1010,103 +1118,33 @@ double PulsarSpectrum::getDecorrectedTime(double CorrectedTime)
  *
  * <br>
  * This method returns the correspondent inverse-demodulated time of each photons, includingRoemer delay, Einstein delay 
- * and Shapiro delay
+ * and Shapiro delay. It uses Newton's method, with the derivative of the delays from getBinaryDemodulationRate,
+ * starting from the time obtained by subtracting the delay at CorrectedTime.
  */
 double PulsarSpectrum::getBinaryDemodulationInverse( double CorrectedTime)
 {
+  double tcurr = CorrectedTime - getBinaryDemodulation(CorrectedTime,0);
+  double fcurr = getIterativeDemodulatedTime(tcurr,0) - CorrectedTime;
 
-  double deltaMin = m_asini*(1.+m_ecc);//-m_asini*std::sqrt(1.-m_ecc*m_ecc);
-
-  double tcurr = CorrectedTime-deltaMin;
-  double fcurr = getIterativeDemodulatedTime(tcurr,0);
-  //  double fcurr_ct = CorrectedTime;
-
-  if (DEBUG)
+  int nIterations = 0;
+  while ((fabs(fcurr) > InverseDemodTol) && (nIterations < InverseMaxIter))
     {
-      std::cout << "Get inverse demodulated time for t=" << CorrectedTime << std::endl;
-    }
+      double slope = 1. + getBinaryDemodulationRate(tcurr);
+      if (!((slope > 0.5) && (slope < 2.)))
+	slope = 1.;
 
-  //double deltaStep = 10.;
-  int s = 0;
-  int SignDirection = 0;
-  double StartStep = 1.0*int(log10(fabs(deltaMin/10.)));
-  double deltaStep =  pow(10.,(StartStep-s));
-  //std::cout << "START " << StartStep << " dmin " << deltaMin << std::endl;
-  if (CorrectedTime <= fcurr) // function increasing
-    {
-      //      std::cout << "Case 1: de-crescent function" << std::endl;
-      SignDirection = 1;
+      tcurr = tcurr - fcurr/slope;
+      fcurr = getIterativeDemodulatedTime(tcurr,0) - CorrectedTime;
+      nIterations++;
     }
-  else
+
+  if (DEBUG)
     {
-      //std::cout << "Case 2: crescent function" << std::endl;
-      SignDirection = 2;
+      std::cout << std::setprecision(30) << "Inverse demodulated time for t=" << CorrectedTime << " is " << tcurr
+		<< " after " << nIterations << " iterations; df=" << fcurr << std::endl;
     }
 
-  /*
-  std::cout << "\n\n***\n"<<m_PSRname<<"tstart= " << tcurr << " -->fcurr= " << fcurr 
-	    << " -->fcurr_CT= " << CorrectedTime << " inital delta=" 
-	    << deltaStep << " sign" << SignDirection << std::endl;
-  */
-
-  //double tModMid=0.;
-  int nMaxStepIterations=0;	
-      while ( fabs(CorrectedTime-fcurr) > InverseDemodTol)
-	{
-
-          nMaxStepIterations=0;
-	  if (SignDirection == 1)
-	    {
-	      while ((fcurr > CorrectedTime) && (nMaxStepIterations <1000))
-		{ 
-		  tcurr = tcurr+deltaStep;
-		  fcurr = getIterativeDemodulatedTime(tcurr,0);
-	          nMaxStepIterations++;	 
-                  if (fcurr < CorrectedTime)
-                   {
-		     break;
-                   }
-                  //std::cout << std::setprecision(30) << nMaxStepIterations <<" tcurr=>" << tcurr << " fcurr " << fcurr 
-		  //	<< "df=" << CorrectedTime-fcurr << std::endl; 
-		}
-	    }
-	  else
-	    while ((fcurr < CorrectedTime) && (nMaxStepIterations <1000))
-	      { 
-		tcurr = tcurr+deltaStep;
-		fcurr = getIterativeDemodulatedTime(tcurr,0);
-                nMaxStepIterations++;
-		//std::cout << std::setprecision(30) << nMaxStepIterations << " tcurr=>" << tcurr << " fcurr " << fcurr 
-		  //<< "df=" << CorrectedTime-fcurr << std::endl; 
-             if (fcurr > CorrectedTime)
-                   {
-		     break;
-                   }
-	      
-
-}
-	    
-	  
-	  tcurr = tcurr-deltaStep;
-	  fcurr = getIterativeDemodulatedTime(tcurr,0);
-	  s++;
-	  deltaStep =  pow(10.,(StartStep-s));
-	  //std::cout << "\n" << m_PSRname << "  Target superated, decreasing to " << deltaStep 
-	    //  << " and starting again1 from " << tcurr << std::endl;
-	  //std::cout << std::setprecision(30) << CorrectedTime << 
-	  //" <--" << fcurr << " df=" << CorrectedTime-fcurr << std::endl;
-	  if ((s > 8) || (deltaStep < 1e-7))
-	    {
-	      //std::cout << "Skipping ! " << std::endl;
-	      break;
-	    }
-	}
-
-      //      std::cout << std::setprecision(30) <<  s << " -> " << CorrectedTime 
-      //	<< " <--" << fcurr 
-      //	<< " df=" << CorrectedTime-fcurr << std::endl;
-
-      return tcurr;
+  return tcurr;
 }
 
 /////////////////////////////////////////////
@@ -1627,10 +1665,9 @@ void PulsarSpectrum::ApplyTimingNoise(double TnoiseInputTime)
 		PhaseWithNoise+=1.;
 	    }
 
-	  if (::getenv("PULSAR_OUT_TNOISE"))
+	  if (m_TimingNoiseLog)
 	    {
 
-	      std::ofstream TimingNoiseLogFile((m_PSRname + "TimingNoise.log").c_str(),std::ios::app);
 	      m_f2NoNoise = 0.;
 	      double ft_l = GetFt(TnoiseInputTime,m_f0NoNoise,m_f1NoNoise,m_f2NoNoise);
 	      double ft_n = GetFt(TnoiseInputTime,m_f0,m_f1,m_f2);
@@ -1639,15 +1676,9 @@ void PulsarSpectrum::ApplyTimingNoise(double TnoiseInputTime)
 	      double ft2_l = m_f2NoNoise;//
 	      double ft2_n = m_f2;//
 	      
-	      TimingNoiseLogFile << std::setprecision(30) << TnoiseInputTime-(StartMissionDateMJD)*SecsOneDay
-				 << "\t" << m_TimingNoiseActivity
-				 << "\t" << S0 
-				 << "\t" << S1
-				 << "\t" << S2 
-				 << "\t" <<ft_l << "\t" << ft_n 
-				 << "\t" <<ft1_l << "\t" << ft1_n 
-				 << "\t" <<ft2_l << "\t" << ft2_n 			 
-				 << "\t" << PhaseNoNoise << "\t" << PhaseWithNoise << std::endl;
+	      double row[13] = {TnoiseInputTime-(StartMissionDateMJD)*SecsOneDay, m_TimingNoiseActivity,
+				S0, S1, S2, ft_l, ft_n, ft1_l, ft1_n, ft2_l, ft2_n, PhaseNoNoise, PhaseWithNoise};
+	      m_TimingNoiseLog->writeRow(row);
 	    }
 	  
 
@@ -1993,7 +2024,7 @@ void PulsarSpectrum::WritePulsarLog()
 
   //Write infos to Log file  
   
-  std::ofstream PulsarLog(m_LogFileName.c_str(),std::ios::app);
+  std::ostringstream PulsarLog;
 
   PulsarLog << "** PulsarSpectrum: " << "********   PulsarSpectrum Log for pulsar" << m_PSRname << std::endl;
   PulsarLog << "** PulsarSpectrum: "<< "**   Name : " << m_PSRname << std::endl;
@@ -2112,7 +2143,13 @@ void PulsarSpectrum::WritePulsarLog()
       PulsarLog << "** PulsarSpectrum: "<< "**************************************************" << std::endl;
     }
 
-  PulsarLog.close();
+  if (m_Log)
+    m_Log->write(PulsarLog.str());
+  else
+    {
+      std::ofstream PulsarLogFile(m_LogFileName.c_str(),std::ios::app);
+      PulsarLogFile << PulsarLog.str();
+    }
 }
 
 //////////////////////////////////////////////////////////
@@ -2251,6 +2288,12 @@ std::string PulsarSpectrum::parseParamList(std::string input, unsigned int index
 */
 void PulsarSpectrum::WriteToLog(std::string Line)
 {
+  if (m_Log)
+    {
+      m_Log->write("** PulsarSpectrum: " + Line + "\n");
+      return;
+    }
+
   std::ofstream PulsarLog(m_LogFileName.c_str(),std::ios::app);
   PulsarLog << "** PulsarSpectrum: " << Line << std::endl;
   PulsarLog.close();
@@ -0,0 +1,168 @@
+/////////////////////////////////////////////////
+// File SolarSystemCache.cxx
+// Implementation of SolarSystemCache class
+//////////////////////////////////////////////////
+
+#include "Pulsar/SolarSystemCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace cst;
+
+/////////////////////////////////////////////////
+SolarSystemCache * SolarSystemCache::instance()
+{
+  static SolarSystemCache cache;
+  return &cache;
+}
+
+/////////////////////////////////////////////////
+SolarSystemCache::SolarSystemCache()
+  : m_solSys(astro::SolarSystem::EARTH), m_step(baryTableMaxStep), m_tol(0.), m_initialized(false)
+{
+  astro::JulianDate JDStart(StartMissionDateMJD+JDminusMJD);
+  m_earthOrbit = new astro::EarthOrbit(JDStart);
+}
+
+/////////////////////////////////////////////////
+SolarSystemCache::~SolarSystemCache()
+{
+  delete m_earthOrbit;
+}
+
+/////////////////////////////////////////////
+/*!
+ * \param timeMET Time in MET (TT, in s.)
+ */
+SolarSystemCache::Ephemeris SolarSystemCache::computeEphemeris(double timeMET)
+{
+  astro::JulianDate ttJD(StartMissionDateMJD+JDminusMJD);
+  ttJD = ttJD+timeMET/SecsOneDay;
+
+  Ephemeris eph;
+  eph.tdbMinusTT = m_earthOrbit->tdb_minus_tt(ttJD);
+  eph.barycenter = m_solSys.getBarycenter(ttJD);
+  eph.solarVector = m_solSys.getSolarVector(ttJD);
+  return eph;
+}
+
+/////////////////////////////////////////////
+/*!
+ * \param timeMET Time in MET (TT, in s.)
+ * \param eph Interpolated ephemerides (output)
+ */
+bool SolarSystemCache::getEphemeris(double timeMET, Ephemeris &eph)
+{
+  if (!m_initialized)
+    InitTable(timeMET);
+
+  if (m_tol <= 0.)
+    return false;
+
+  double node = floor(timeMET/m_step);
+  double u = timeMET/m_step - node;
+  long chunk = long(floor(node/baryTableChunk));
+
+  std::map<long, std::vector<double> >::iterator it = m_table.find(chunk);
+  if (it == m_table.end())
+    {
+      //Nodes from one before the chunk to two after it, as needed by the interpolation
+      std::vector<double> nodes((baryTableChunk+3)*s_nValues);
+      try {
+	for (int i = 0; i < baryTableChunk+3; i++)
+	  {
+	    Ephemeris nodeEph = computeEphemeris((double(chunk)*baryTableChunk + i - 1)*m_step);
+	    double *f = &nodes[i*s_nValues];
+	    f[0] = nodeEph.tdbMinusTT;
+	    f[1] = nodeEph.barycenter.x();
+	    f[2] = nodeEph.barycenter.y();
+	    f[3] = nodeEph.barycenter.z();
+	    f[4] = nodeEph.solarVector.x();
+	    f[5] = nodeEph.solarVector.y();
+	    f[6] = nodeEph.solarVector.z();
+	  }
+      } catch (astro::SolarSystem::BadDate & )
+	{
+	  nodes.clear();
+	}
+      it = m_table.insert(std::make_pair(chunk, nodes)).first;
+    }
+
+  if (it->second.empty())
+    return false;
+
+  const double *f = &it->second[(long(node) - chunk*baryTableChunk)*s_nValues];
+  double w0 = - u*(u-1.)*(u-2.)/6.;
+  double w1 = (u+1.)*(u-1.)*(u-2.)/2.;
+  double w2 = - (u+1.)*u*(u-2.)/2.;
+  double w3 = (u+1.)*u*(u-1.)/6.;
+
+  double v[s_nValues];
+  for (int i = 0; i < s_nValues; i++)
+    v[i] = w0*f[i] + w1*f[i+s_nValues] + w2*f[i+2*s_nValues] + w3*f[i+3*s_nValues];
+
+  eph.tdbMinusTT = v[0];
+  eph.barycenter = CLHEP::Hep3Vector(v[1],v[2],v[3]);
+  eph.solarVector = CLHEP::Hep3Vector(v[4],v[5],v[6]);
+  return true;
+}
+
+/////////////////////////////////////////////
+/*!
+ * \param timeMET Time of the first request, in MET (TT, in s.)
+ *
+ * <br>
+ * Starting from baryTableMaxStep, the node spacing is halved until the interpolation error at the middle
+ * of an interval, where it is largest, is below the bound for TDB-TT and for each component of the vectors,
+ * at timeMET and at weekly intervals after it, or until the spacing reaches baryTableMinStep.
+ * Since the pulsar directions are unit vectors, the error of the total correction is then within
+ * a few times the bound.
+ */
+void SolarSystemCache::InitTable(double timeMET)
+{
+  m_initialized = true;
+  m_table.clear();
+  m_tol = baryTableTol;
+  if (::getenv("PULSAR_BARY_TABLE_TOL"))
+    {
+      m_tol = std::atof(::getenv("PULSAR_BARY_TABLE_TOL"));
+    }
+
+  if (m_tol <= 0.)
+    return;
+
+  m_step = baryTableMaxStep;
+  try {
+    while (true)
+      {
+	double maxErr = 0.;
+	for (int k = 0; k < 4; k++)
+	  {
+	    double t = timeMET + k*7.*SecsOneDay;
+	    Ephemeris f[4];
+	    for (int i = 0; i < 4; i++)
+	      f[i] = computeEphemeris(t + (i-1)*m_step);
+	    Ephemeris mid = computeEphemeris(t + 0.5*m_step);
+
+	    double dtdb = (-f[0].tdbMinusTT + 9.*f[1].tdbMinusTT + 9.*f[2].tdbMinusTT - f[3].tdbMinusTT)/16.
+	      - mid.tdbMinusTT;
+	    CLHEP::Hep3Vector dbary = (f[0].barycenter*(-1.) + f[1].barycenter*9. + f[2].barycenter*9.
+				       - f[3].barycenter)/16. - mid.barycenter;
+	    CLHEP::Hep3Vector dsun = (f[0].solarVector*(-1.) + f[1].solarVector*9. + f[2].solarVector*9.
+				      - f[3].solarVector)/16. - mid.solarVector;
+
+	    maxErr = std::max(maxErr, fabs(dtdb));
+	    maxErr = std::max(maxErr, std::max(fabs(dbary.x()), std::max(fabs(dbary.y()), fabs(dbary.z()))));
+	    maxErr = std::max(maxErr, std::max(fabs(dsun.x()), std::max(fabs(dsun.y()), fabs(dsun.z()))));
+	  }
+	if ((maxErr < m_tol) || (m_step/2. < baryTableMinStep))
+	  break;
+	m_step /= 2.;
+      }
+  } catch (astro::SolarSystem::BadDate & )
+    {
+      //No ephemerides at the first time requested: always compute directly
+      m_tol = 0.;
+    }
+}
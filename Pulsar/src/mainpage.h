@@ -34,9 +34,15 @@ The source code for PulsarSpectrum is included in the celestialSources package u
 * PULSAR_OUT_TNOISE
 * If not defined, no file with timing noise residual is saved, otherwise if is set (to whatever value) a txt file called PulsarNameTNoiseLog.txt is created for each pulsar called PulsarName;
 *
+* PULSAR_LOG_BINARY
+* If not defined, the barycentric corrections, binary demodulation and timing noise logs are written as text, at least once a second; otherwise if is set (to whatever value) they are written as binary files of doubles, named as the text logs with the extension .bin added, which can be converted to text with PulsarLog::convertToText
+*
 * PULSAR_NO_DB
 * If not defined the txt files containing the database are set, otherwise if this env variable is set (to whatever value) no output .txt database file will be written 
 *
+* PULSAR_BARY_TABLE_TOL
+* Error bound (in s.) of the table of Solar System ephemerides, shared by all the pulsars, from which the barycentric corrections are interpolated. If not defined, the default is 1e-8 s; if set to 0, the corrections are always computed directly from the ephemerides
+*
 * PULSAR_EPH
 * Ephemerides label in the output D4 of the simulations. If not defined, the defaults ephemerides used is DE405
 *
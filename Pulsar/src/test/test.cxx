@@ -0,0 +1,188 @@
+/////////////////////////////////////////////////
+// File test.cxx
+// Test program for the time corrections of PulsarSpectrum
+//////////////////////////////////////////////////
+
+#include "Pulsar/PulsarSpectrum.h"
+#include "Pulsar/PulsarConstants.h"
+#include "Pulsar/SolarSystemCache.h"
+#include "facilities/commonUtilities.h"
+#include "TRandom.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace cst;
+
+namespace {
+  //! Binary pulsar of the user library, from BasicDataList.txt and BasicBinDataList.txt
+  const std::string s_params = "PSRMUROB, 50.0, -25.0, 1.0e5, 3.0e8, 1, 63443, 3, 1e6, 30e6, -1.9, 2.0";
+
+  //! Number of random times for each check
+  const int s_nTimes = 2000;
+
+  void check(bool ok, const std::string &what, double time, double value)
+  {
+    if (!ok)
+      {
+	std::ostringstream message;
+	message.precision(20);
+	message << what << " at t=" << time << ": " << value;
+	throw std::runtime_error(message.str());
+      }
+  }
+}
+
+/////////////////////////////////////////////////
+/*!
+ * \param psr Pulsar to be tested
+ * \param random Random generator of the times
+ *
+ * Check that getDecorrectedTime inverts getBaryCorr within baryCorrTol, both inside the FT2 range and
+ * across its end, where the corrections drop to zero.
+ */
+void test_baryCorrInverse(PulsarSpectrum &psr, TRandom &random)
+{
+  double offset = (StartMissionDateMJD)*SecsOneDay;
+  double lastCorrected = offset + psr.getFT2StopTime() - 510.;
+
+  for (int i = 0; i < 2*s_nTimes; i++)
+    {
+      //half of the times are in the last year of the FT2 range, and half within 2000 s of the last corrected time
+      double t = (i < s_nTimes) ? random.Uniform(lastCorrected - 3e7, lastCorrected - 2000.)
+	: random.Uniform(lastCorrected - 2000., lastCorrected + 2000.);
+      double corrected = t + psr.getBaryCorr(t,0);
+      double decorrected = psr.getDecorrectedTime(corrected);
+
+      double residual = decorrected + psr.getBaryCorr(decorrected,0) - corrected;
+      check(fabs(residual) <= baryCorrTol, "Barycentric inversion residual", t, residual);
+
+      //just after the end, a corrected time may also be reached from before the end, which is preferred
+      if ((t <= lastCorrected) || (t > lastCorrected + 510.))
+	check(fabs(decorrected - t) <= 2.*baryCorrTol, "Barycentric round trip", t, decorrected - t);
+    }
+}
+
+/////////////////////////////////////////////////
+/*!
+ * \param psr Binary pulsar to be tested
+ * \param random Random generator of the times
+ *
+ * Check that getBinaryDemodulationInverse inverts getIterativeDemodulatedTime within InverseDemodTol.
+ */
+void test_binaryDemodulationInverse(PulsarSpectrum &psr, TRandom &random)
+{
+  double offset = (StartMissionDateMJD)*SecsOneDay;
+  double lastCorrected = offset + psr.getFT2StopTime() - 510.;
+
+  for (int i = 0; i < s_nTimes; i++)
+    {
+      double t = random.Uniform(lastCorrected - 3e7, lastCorrected + 2000.);
+      double demodulated = psr.getIterativeDemodulatedTime(t,0);
+      double modulated = psr.getBinaryDemodulationInverse(demodulated);
+
+      double residual = psr.getIterativeDemodulatedTime(modulated,0) - demodulated;
+      check(fabs(residual) <= InverseDemodTol, "Binary inversion residual", t, residual);
+      check(fabs(modulated - t) <= 2.*InverseDemodTol, "Binary round trip", t, modulated - t);
+    }
+}
+
+/////////////////////////////////////////////////
+/*!
+ * \param psr Pulsar to be tested
+ * \param random Random generator of the times
+ *
+ * Check that retrieveNextTimeTilde finds the time of the requested number of turns within the tolerance used by
+ * interval, for intervals of up to one day, without falling back to bisection.
+ */
+void test_nextTimeTilde(PulsarSpectrum &psr, TRandom &random)
+{
+  double offset = (StartMissionDateMJD)*SecsOneDay;
+  double lastCorrected = offset + psr.getFT2StopTime() - 510.;
+  double period = 1./(psr.getTurns(lastCorrected + 0.5) - psr.getTurns(lastCorrected - 0.5));
+  double err = ephemCorrTol/period;
+
+  long calls = psr.getNextTimeCalls();
+  long fallbacks = psr.getNextTimeFallbacks();
+
+  for (int i = 0; i < s_nTimes; i++)
+    {
+      double t = random.Uniform(lastCorrected - 3e7, lastCorrected);
+      double interval = pow(10., random.Uniform(-3., log10(SecsOneDay)));
+      double totalTurns = psr.getTurns(t) + interval/period;
+      double tNext = psr.retrieveNextTimeTilde(t, totalTurns, err);
+
+      double residual = totalTurns - psr.getTurns(tNext);
+      check(fabs(residual) <= err, "Next time residual (turns)", t, residual);
+      check(tNext > t, "Next time before start", t, tNext - t);
+    }
+
+  check(psr.getNextTimeCalls() - calls == s_nTimes, "Next time calls", 0., psr.getNextTimeCalls() - calls);
+  check(psr.getNextTimeFallbacks() == fallbacks, "Next time fallbacks to bisection", 0.,
+	psr.getNextTimeFallbacks() - fallbacks);
+}
+
+/////////////////////////////////////////////////
+/*!
+ * \param psr Pulsar giving the time range
+ * \param random Random generator of the times
+ *
+ * Check that the ephemerides interpolated by SolarSystemCache agree with those computed directly within a few
+ * times the error bound of the table.
+ */
+void test_solarSystemCache(PulsarSpectrum &psr, TRandom &random)
+{
+  SolarSystemCache *cache = SolarSystemCache::instance();
+  double lastCorrected = psr.getFT2StopTime() - 510.;
+  double tol = 5.*cache->tolerance();
+
+  for (int i = 0; i < s_nTimes; i++)
+    {
+      double timeMET = random.Uniform(lastCorrected - 3e7, lastCorrected);
+      SolarSystemCache::Ephemeris eph;
+      if (!cache->getEphemeris(timeMET, eph))
+	{
+	  check(cache->tolerance() <= 0., "No interpolated ephemerides", timeMET, cache->tolerance());
+	  continue;
+	}
+      SolarSystemCache::Ephemeris direct = cache->computeEphemeris(timeMET);
+
+      CLHEP::Hep3Vector dbary = eph.barycenter - direct.barycenter;
+      CLHEP::Hep3Vector dsun = eph.solarVector - direct.solarVector;
+      check(fabs(eph.tdbMinusTT - direct.tdbMinusTT) <= tol, "Table error of TDB-TT", timeMET,
+	    eph.tdbMinusTT - direct.tdbMinusTT);
+      check(dbary.mag() <= tol, "Table error of the Earth position", timeMET, dbary.mag());
+      check(dsun.mag() <= tol, "Table error of the Sun direction", timeMET, dsun.mag());
+    }
+}
+
+/////////////////////////////////////////////////
+int main()
+{
+  try
+    {
+      //Use the data of this package, and write no logs or database files
+      if (!::getenv("PULSARDATA"))
+	::setenv("PULSARDATA", facilities::commonUtilities::getDataPath("Pulsar").c_str(), 1);
+      ::setenv("PULSAR_OUTPUT_LEVEL", "0", 1);
+      ::setenv("PULSAR_NO_DB", "1", 1);
+
+      PulsarSpectrum psr(s_params);
+      TRandom random;
+      random.SetSeed(1234);
+
+      test_baryCorrInverse(psr, random);
+      test_binaryDemodulationInverse(psr, random);
+      test_nextTimeTilde(psr, random);
+      test_solarSystemCache(psr, random);
+    }
+  catch (std::exception &eObj)
+    {
+      std::cout << eObj.what() << std::endl;
+      return 1;
+    }
+  std::cout << "All tests passed." << std::endl;
+  return 0;
+}
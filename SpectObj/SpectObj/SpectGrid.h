@@ -0,0 +1,123 @@
+/** @file SpectGrid.h
+  @brief declaration of SpectAxis and SpectGrid classes
+
+  $Header$
+
+*/
+#ifndef SpectGrid_H
+#define SpectGrid_H
+#include <vector>
+
+/*!
+  \class SpectAxis
+  \brief Binning of one axis of a SpectGrid.
+
+  Bins are numbered as in a ROOT TAxis: 1..n are the bins in range, 0 and n+1
+  the underflow and overflow. Both fixed width and variable width binnings are
+  supported, and FindBin, GetBinCenter, ... give the same results as TAxis.
+*/
+class SpectAxis
+{
+ public:
+  SpectAxis() : m_nbins(0), m_xmin(0), m_xmax(0) {}
+  /// Fixed width binning.
+  SpectAxis(int nbins, double xmin, double xmax);
+  /// Variable width binning, edges has nbins+1 entries.
+  SpectAxis(int nbins, const double *edges);
+
+  inline int    GetNbins() const { return m_nbins; }
+  inline double GetXmin()  const { return m_xmin; }
+  inline double GetXmax()  const { return m_xmax; }
+  inline bool   IsFixed()  const { return m_edges.empty(); }
+
+  inline int FindBin(double x) const
+    {
+      if(x < m_xmin)    return 0;
+      if(!(x < m_xmax)) return m_nbins+1;
+      if(IsFixed())     return 1 + int(m_nbins*(x-m_xmin)/(m_xmax-m_xmin));
+      return FindVariableBin(x);
+    }
+  inline double GetBinWidth(int bin) const
+    {
+      if(IsFixed()) return (m_xmax-m_xmin)/m_nbins;
+      if(bin < 1) bin = 1;
+      if(bin > m_nbins) bin = m_nbins;
+      return m_edges[bin] - m_edges[bin-1];
+    }
+  inline double GetBinLowEdge(int bin) const
+    {
+      if(IsFixed() || bin < 1 || bin > m_nbins+1)
+	return m_xmin + (bin-1)*((m_xmax-m_xmin)/m_nbins);
+      return m_edges[bin-1];
+    }
+  inline double GetBinCenter(int bin) const
+    {
+      if(IsFixed() || bin < 1 || bin > m_nbins)
+	{
+	  double binwidth = (m_xmax-m_xmin)/m_nbins;
+	  return m_xmin + (bin-1)*binwidth + 0.5*binwidth;
+	}
+      return 0.5*(m_edges[bin-1] + m_edges[bin]);
+    }
+  /// Fills edges with the nbins+1 bin edges.
+  void GetEdges(std::vector<double> &edges) const;
+
+ private:
+  int FindVariableBin(double x) const;
+
+  int m_nbins;
+  double m_xmin, m_xmax;
+  /// bin edges, empty for fixed width binning
+  std::vector<double> m_edges;
+};
+
+/*!
+  \class SpectGrid
+  \brief Dense time x energy grid of photon counts used by SpectObj.
+
+  The contents are stored contiguously, row-major in time: all the energy bins
+  of a time bin are adjacent, so sums over energy run over contiguous memory.
+  Only the bins in range are stored; under/overflow bins read as zero and the
+  integrals are clamped to the range of the axes.
+*/
+class SpectGrid
+{
+ public:
+  SpectGrid() : m_nt(0), m_ne(0) {}
+  SpectGrid(const SpectAxis &times, const SpectAxis &energies);
+
+  inline const SpectAxis &GetTimeAxis()   const { return m_times; }
+  inline const SpectAxis &GetEnergyAxis() const { return m_energies; }
+  inline int GetNt() const { return m_nt; }
+  inline int GetNe() const { return m_ne; }
+
+  /// Energy bins 1..ne of time bin ti (1..nt); Row(ti)[ei-1] is bin (ti,ei).
+  inline const double *Row(int ti) const { return &m_data[(ti-1)*m_ne]; }
+  inline double *Row(int ti) { return &m_data[(ti-1)*m_ne]; }
+
+  inline double GetBinContent(int ti, int ei) const
+    {
+      if(ti < 1 || ti > m_nt || ei < 1 || ei > m_ne) return 0.0;
+      return m_data[(ti-1)*m_ne + ei-1];
+    }
+  inline void SetBinContent(int ti, int ei, double value)
+    {
+      m_data[(ti-1)*m_ne + ei-1] = value;
+    }
+
+  void Scale(double factor);
+  /// Sum of the bins in [ti1,ti2]x[ei1,ei2].
+  double Integral(int ti1, int ti2, int ei1, int ei2) const;
+  /** Integral over energy bins [ei1,ei2] for each time bin: lc is resized to
+      nt+2 and indexed by time bin number (lc[0] = lc[nt+1] = 0). */
+  void LightCurve(int ei1, int ei2, std::vector<double> &lc) const;
+  /** Integral over time bins [ti1,ti2] for each energy bin: sp is resized to
+      ne+2 and indexed by energy bin number (sp[0] = sp[ne+1] = 0). */
+  void Spectrum(int ti1, int ti2, std::vector<double> &sp) const;
+
+ private:
+  SpectAxis m_times, m_energies;
+  int m_nt, m_ne;
+  std::vector<double> m_data;
+};
+#endif
@@ -9,6 +9,7 @@
 #include "TH2D.h"
 #include "TH1D.h"
 #include "TROOT.h"
+#include "SpectObj/SpectGrid.h"
 #if 0 //THB
 #include "TRandom.h"
 #endif
@@ -53,16 +54,8 @@ class SpectObj
   
   ~SpectObj()
     {
-      delete spec;
       delete times;
-      delete Probability;
-      delete Nv;
       delete m_SpRandGen;
-      if (PeriodicSpectrumIsComputed == true ) 
-	{
-	  delete PeriodicSpectrum;
-	  delete PeriodicLightCurve;
-	}
       std::cout<<" SpectObj: Generated photons : "<<counts<<" over "<<m_AreaDetector<<" m^2 "<<std::endl;
     }
   void GetUniqueName(void *ptr, std::string & name);
@@ -80,6 +73,13 @@ class SpectObj
   void ComputeProbability(double enph);
   TH1D *N(TH1D *EN);
   photon GetPhoton(double t0, double enph);
+  /// Fills buffer with up to n successive photons above enph, starting at t0 and 
+  /// stopping after the first photon at or beyond tstop. Returns the number written,
+  /// which is less than n once a transient is over: the end marker (time 1e8) that
+  /// GetPhoton returns then is never written to the buffer.
+  /// The sequence is the same as chaining GetPhoton(ph.time, enph) from t0.
+  /// Throws std::runtime_error if the source type is neither transient nor periodic.
+  int GetPhotons(double t0, double tstop, double enph, photon * buffer, int n);
   
   void SetAreaDetector(double AreaDetector=6.0);
   inline void SetFluxFactor(double FluxFactor=1.0) {m_FluxFactor = FluxFactor;};
@@ -102,6 +102,13 @@ class SpectObj
   TH1D *CloneTimes();
     
  private:
+  void ComputeSampler();
+  double SampleEnergy(int ti1, int ti2, int ei);
+  photon NextTransientPhoton(double t0, double enph, int ei);
+  photon NextPeriodicPhoton(double t0, int ei);
+  void InterpolateSpectrum(double t, std::vector<double> &sp) const;
+  TH1D *MakeHistogram(const SpectAxis &axis, const std::vector<double> *contents = 0);
+
   int counts;
   double  m_AreaDetector;
   double  m_FluxFactor;
@@ -111,7 +118,8 @@ class SpectObj
 #else
   UniformRandom * m_SpRandGen;
 #endif
-  TH2D* Nv;
+  /// ph per time and energy bin, over m_AreaDetector
+  SpectGrid Nv;
   int ne,nt;
   int sourceType; //"0=Transient,1=Periodic"
   double emin,emax;
@@ -121,9 +129,17 @@ class SpectObj
   double m_z;
   double m_meanRate;
   
-  TH1D *spec,*times,*Probability,*PeriodicSpectrum,*PeriodicLightCurve;
+  /// only made if GetTimes(0.0) is called
+  TH1D *times;
+  /// Cumulative number of photons above enph up to each time bin [ph]
+  std::vector<double> Probability;
+  /// Cumulative spectrum and light curve above enph for periodic sources [ph]
+  std::vector<double> PeriodicSpectrum, PeriodicLightCurve;
   photon ph;
-  bool ProbabilityIsComputed, PeriodicSpectrumIsComputed;
+  /// Summed-area table of Nv: (nt+1)x(ne+1), element [ti*(ne+1)+ei] is the 
+  /// number of photons in time bins 1..ti and energy bins 1..ei [ph]
+  std::vector<double> m_CumulativeNv;
+  bool ProbabilityIsComputed, PeriodicSpectrumIsComputed, SamplerIsComputed;
   IRB::EblAtten * m_tau;
 
    static bool s_gRandom_seed_set;
@@ -0,0 +1,95 @@
+/** @file SpectGrid.cxx
+    @brief implementation of SpectAxis and SpectGrid classes
+
+    $Header$
+*/
+#include <algorithm>
+
+#include "SpectObj/SpectGrid.h"
+
+SpectAxis::SpectAxis(int nbins, double xmin, double xmax)
+  : m_nbins(nbins), m_xmin(xmin), m_xmax(xmax)
+{}
+
+SpectAxis::SpectAxis(int nbins, const double *edges)
+  : m_nbins(nbins), m_xmin(edges[0]), m_xmax(edges[nbins]),
+    m_edges(edges, edges+nbins+1)
+{}
+
+int SpectAxis::FindVariableBin(double x) const
+{
+  // last edge at or below x, as TMath::BinarySearch
+  return std::upper_bound(m_edges.begin(), m_edges.end(), x) - m_edges.begin();
+}
+
+void SpectAxis::GetEdges(std::vector<double> &edges) const
+{
+  if(!IsFixed())
+    {
+      edges = m_edges;
+      return;
+    }
+  edges.resize(m_nbins+1);
+  for(int i = 0; i <= m_nbins; i++)
+    edges[i] = GetBinLowEdge(i+1);
+}
+
+//////////////////////////////////////////////////
+SpectGrid::SpectGrid(const SpectAxis &times, const SpectAxis &energies)
+  : m_times(times), m_energies(energies),
+    m_nt(times.GetNbins()), m_ne(energies.GetNbins()),
+    m_data(m_nt*m_ne, 0.0)
+{}
+
+void SpectGrid::Scale(double factor)
+{
+  const int n = m_data.size();
+  double *data = &m_data[0];
+  for(int i = 0; i < n; i++)
+    data[i] *= factor;
+}
+
+double SpectGrid::Integral(int ti1, int ti2, int ei1, int ei2) const
+{
+  ti1 = std::max(ti1,1);
+  ti2 = std::min(ti2,m_nt);
+  ei1 = std::max(ei1,1);
+  ei2 = std::min(ei2,m_ne);
+  double sum = 0.0;
+  for(int ti = ti1; ti <= ti2; ti++)
+    {
+      const double *row = Row(ti);
+      for(int ei = ei1; ei <= ei2; ei++)
+	sum += row[ei-1];
+    }
+  return sum;
+}
+
+void SpectGrid::LightCurve(int ei1, int ei2, std::vector<double> &lc) const
+{
+  ei1 = std::max(ei1,1);
+  ei2 = std::min(ei2,m_ne);
+  lc.assign(m_nt+2, 0.0);
+  for(int ti = 1; ti <= m_nt; ti++)
+    {
+      const double *row = Row(ti);
+      double sum = 0.0;
+      for(int ei = ei1; ei <= ei2; ei++)
+	sum += row[ei-1];
+      lc[ti] = sum;
+    }
+}
+
+void SpectGrid::Spectrum(int ti1, int ti2, std::vector<double> &sp) const
+{
+  ti1 = std::max(ti1,1);
+  ti2 = std::min(ti2,m_nt);
+  sp.assign(m_ne+2, 0.0);
+  double *out = &sp[1];
+  for(int ti = ti1; ti <= ti2; ti++)
+    {
+      const double *row = Row(ti);
+      for(int ei = 0; ei < m_ne; ei++)
+	out[ei] += row[ei];
+    }
+}
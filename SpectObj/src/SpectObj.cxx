@@ -10,6 +10,7 @@
 #include <iomanip>
 #include <cmath>
 #include <cstdlib>
+#include <stdexcept>
 
 //#include "SpectObj.h"
 #include "SpectObj/SpectObj.h"
@@ -19,6 +20,7 @@
 #include "CLHEP/Random/RandFlat.h"
 
 #include "TH1.h"
+#include "TRandom.h"
 
 #define DEBUG 0
 
@@ -26,17 +28,54 @@ static const double erg2meV      = 624151.0;
 
 bool SpectObj::s_gRandom_seed_set(false);
 
+namespace {
+  SpectAxis MakeAxis(const TAxis *axis)
+  {
+    const TArrayD *bins = axis->GetXbins();
+    if(bins->GetSize() > 0) 
+      return SpectAxis(axis->GetNbins(), bins->GetArray());
+    return SpectAxis(axis->GetNbins(), axis->GetXmin(), axis->GetXmax());
+  }
+
+  /// Inverse CDF draw over the bins of axis, as TH1::GetRandom does. The
+  /// cumulative content up to bin k is hi[k]-lo[k] (lo may be 0), for k = k0..n;
+  /// bins up to k0 are excluded.
+  double SampleBins(const SpectAxis &axis, const double *hi, const double *lo, int k0)
+  {
+    const int n = axis.GetNbins();
+    const double base  = hi[k0] - (lo ? lo[k0] : 0.0);
+    const double total = hi[n]  - (lo ? lo[n]  : 0.0) - base;
+    if(total <= 0) return 0.0;
+    
+    // Find the last edge k at or below the target
+    const double target = base + gRandom->Rndm() * total;
+    int k  = k0;
+    int kh = n+1;
+    while(kh - k > 1)
+      {
+	int km = (k+kh)/2;
+	if(hi[km] - (lo ? lo[km] : 0.0) <= target) k = km;
+	else kh = km;
+      }
+    if(k >= n) return axis.GetXmax();
+    
+    const double c0 = hi[k]   - (lo ? lo[k]   : 0.0);
+    const double c1 = hi[k+1] - (lo ? lo[k+1] : 0.0);
+    double x = axis.GetBinLowEdge(k+1);
+    if(target > c0)
+      x += axis.GetBinWidth(k+1)*(target-c0)/(c1-c0);
+    return x;
+  }
+}
+
 SpectObj::SpectObj(const TH2D* In_Nv, int type, double z)
 {
   m_AreaDetector = 1.0;
   m_FluxFactor = 1.0;
   sourceType = type;
   
-  Nv   = (TH2D*)In_Nv->Clone(); // ph/kev/s/m²
-  std::string name;
-  GetUniqueName(Nv,name);
-  Nv->SetName(name.c_str());
-  //  Nv->SetDirectory(0);
+  // ph/kev/s/m², the histogram is not kept: only its bins in range are copied
+  Nv = SpectGrid(MakeAxis(In_Nv->GetXaxis()), MakeAxis(In_Nv->GetYaxis()));
   counts=0;
 #if 0 //THB
   m_SpRandGen = new TRandom();
@@ -54,18 +93,18 @@ SpectObj::SpectObj(const TH2D* In_Nv, int type, double z)
 #endif
   sourceType = type; //Max
   
-  ne   = Nv->GetNbinsY();
-  double *en   = new double[ne+1];
-  emin = Nv->GetYaxis()->GetXmin();
-  emax = Nv->GetYaxis()->GetXmax();
+  ne   = Nv.GetNe();
+  emin = Nv.GetEnergyAxis().GetXmin();
+  emax = Nv.GetEnergyAxis().GetXmax();
   
-  nt   = Nv->GetNbinsX();
-  m_Tmin = Nv->GetXaxis()->GetXmin();
-  m_Tmax = Nv->GetXaxis()->GetXmax();
+  nt   = Nv.GetNt();
+  m_Tmin = Nv.GetTimeAxis().GetXmin();
+  m_Tmax = Nv.GetTimeAxis().GetXmax();
   
-  m_TimeBinWidth   = Nv->GetXaxis()->GetBinWidth(0);
+  m_TimeBinWidth   = Nv.GetTimeAxis().GetBinWidth(0);
   m_z = z;
 
+
   std::string EBL_model_fileName(facilities::commonUtilities::joinPath(facilities::commonUtilities::getDataPath("SpectObj"), "EBLmodel.dat"));
   std::ifstream EBL_model_file(EBL_model_fileName.c_str(),std::ios_base::in);
   std::string EBl_model;
@@ -120,58 +159,31 @@ Here we have implemented the "High UV" model from their paper
   if(DEBUG) 
     {
       std::cout<<"EBL absorption Model selected: "<<EBl_model<<std::endl;
-      std::cout<<type<<" SpectObj address:  "<<name<<std::endl;
+      std::cout<<type<<" SpectObj address:  "<<this<<std::endl;
       std::cout<<"nt,tmin,tmax "<<nt<<" "<<m_Tmin<<" "<<m_Tmax<<std::endl;
     }
   //////////////////////////////////////////////////
   
-  
-  for(int ei = 0 ; ei<=ne ; ei++) 
-    {      
-      en[ei] =  Nv->GetYaxis()->GetBinLowEdge(ei+1);
-    }
-  
   double dei;
 
-  for (int ei = 0; ei<ne; ei++)
+  for (int ei = 1; ei<=ne; ei++)
     {
-      dei   = Nv->GetYaxis()->GetBinWidth(ei+1);
-      for(int ti = 0; ti<nt; ti++)
+      dei   = Nv.GetEnergyAxis().GetBinWidth(ei);
+      for(int ti = 1; ti<=nt; ti++)
 	{
-	  Nv->SetBinContent(ti+1, ei+1, 
-			    Nv->GetBinContent(ti+1, ei+1)*dei*m_TimeBinWidth); //[ph/m²]
+	  Nv.SetBinContent(ti, ei, 
+			   In_Nv->GetBinContent(ti, ei)*dei*m_TimeBinWidth); //[ph/m²]
 	}  
     }
   SetAreaDetector(); // this fix the area to 6 square meters (default value) and rescale the histogram
   
-  gDirectory->Delete("spec");
-  gDirectory->Delete("times");
-  gDirectory->Delete("Probability");
-  gDirectory->Delete("PeriodicSpectrum");
-  
-  spec             = new TH1D("spec","spec",ne,en);
-  GetUniqueName(spec ,name);
-  spec->SetName(name.c_str());
-
-  times       = new TH1D("times","times",nt,m_Tmin,m_Tmax);
-  GetUniqueName(times,name);
-  times->SetName(name.c_str());
-
-  Probability = new TH1D("Probability","Probability",nt,m_Tmin,m_Tmax);
-  GetUniqueName(Probability,name);
-  Probability->SetName(name.c_str());
-  
-  PeriodicSpectrum = new TH1D("PeriodicSpectrum","PeriodicSpectrum",ne,en);
-  GetUniqueName(PeriodicSpectrum,name);
-  PeriodicSpectrum->SetName(name.c_str());
-  
-  ProbabilityIsComputed=false;
+  times = 0;
   PeriodicSpectrumIsComputed = false;
+  ProbabilityIsComputed=false;
+  SamplerIsComputed = false;
 
   m_meanRate=0.;
 
-  delete[] en;
-      
   if(DEBUG)  std::cout<<" SpectObj initialized ! ( " << sourceType <<")"<<std::endl;
   //////////////////////////////////////////////////
 }
@@ -180,7 +192,7 @@ Here we have implemented the "High UV" model from their paper
 void SpectObj::SetAreaDetector(double AreaDetector)
 {
   if(DEBUG)  std::cout<<"Set the generation area to "<<AreaDetector<<" m2"<<std::endl;
-  Nv->Scale(AreaDetector/m_AreaDetector); // ph
+  Nv.Scale(AreaDetector/m_AreaDetector); // ph
   m_AreaDetector = AreaDetector;
 }
 
@@ -193,23 +205,35 @@ void SpectObj::GetUniqueName(void *ptr, std::string & name)
   reinterpret_cast<TH1*> (ptr)->SetDirectory(0);
 }
 
-TH1D *SpectObj::CloneSpectrum()
+TH1D *SpectObj::MakeHistogram(const SpectAxis &axis, const std::vector<double> *contents)
 {
+  // ROOT histograms are only built here, when one is requested
+  TH1D *h;
+  if(axis.IsFixed())
+    h = new TH1D("SpectObj","SpectObj",axis.GetNbins(),axis.GetXmin(),axis.GetXmax());
+  else
+    {
+      std::vector<double> edges;
+      axis.GetEdges(edges);
+      h = new TH1D("SpectObj","SpectObj",axis.GetNbins(),&edges[0]);
+    }
   std::string name;
-  TH1D *sp = (TH1D*) spec->Clone();
-  GetUniqueName(sp ,name);
-  sp->SetName(name.c_str());
-  return sp;
+  GetUniqueName(h ,name);
+  h->SetName(name.c_str());
+  if(contents)
+    for(int i = 1; i <= axis.GetNbins(); i++)
+      h->SetBinContent(i,(*contents)[i]);
+  return h;
+}
+
+TH1D *SpectObj::CloneSpectrum()
+{
+  return MakeHistogram(Nv.GetEnergyAxis());
 }
 
 TH1D *SpectObj::CloneTimes()
 {
-  TH1D *lc = (TH1D*) times->Clone();
-  std::string name;
-  GetUniqueName(lc ,name);
-  //  gDirectory->Delete(name.c_str());
-  lc->SetName(name.c_str());
-  return lc;
+  return MakeHistogram(Nv.GetTimeAxis());
 } 
 
 
@@ -218,68 +242,72 @@ TH1D *SpectObj::CloneTimes()
 //////////////////////////////////////////////////
 TH1D *SpectObj::GetSpectrum(double t)
 {
-  TH1D *sp = CloneSpectrum();
-  sp->Scale(0.0);
-  if (t == 0.0) return sp;
-  int ti = Nv->GetXaxis()->FindBin(t);
-  double dt0 = t - (Nv->GetXaxis()->GetBinCenter(ti));
-  double sp0,sp1,sp2;
+  if (t == 0.0) return CloneSpectrum();
+  std::vector<double> sp(ne+2,0.0);
+  InterpolateSpectrum(t, sp);
+  return MakeHistogram(Nv.GetEnergyAxis(), &sp); //ph
+}
+
+void SpectObj::InterpolateSpectrum(double t, std::vector<double> &sp) const
+{
+  int ti = Nv.GetTimeAxis().FindBin(t);
+  double dt0 = t - Nv.GetTimeAxis().GetBinCenter(ti);
+  sp.assign(ne+2,0.0);
+  double *out = &sp[1];
+  if(ti < 1 || (ti > nt && !(dt0 < 0))) 
+    return;
+  if(ti > nt) 
+    {
+      // just above the last bin: interpolate towards the empty overflow bin
+      const double *prev = Nv.Row(nt);
+      for(int ei = 0; ei < ne; ei++)
+	out[ei] = -prev[ei]/m_TimeBinWidth * dt0;
+      return;
+    }
+  const double *row = Nv.Row(ti);
   if(dt0>0 && ti<nt)
     {
-      for(int ei = 1; ei <= ne; ei++)
-	{
-	  sp1 = Nv->GetBinContent(ti,ei);
-	  sp2 = Nv->GetBinContent(ti+1,ei);
-	  sp0 = (sp2-sp1)/m_TimeBinWidth * dt0 + sp1;
-	  sp->SetBinContent(ei,sp0);
-	}
+      const double *next = Nv.Row(ti+1);
+      for(int ei = 0; ei < ne; ei++)
+	out[ei] = (next[ei]-row[ei])/m_TimeBinWidth * dt0 + row[ei];
     }
   else if(dt0<0 && ti>1)
     {
-      for(int ei = 1; ei <= ne; ei++)
-	{
-	  sp1 = Nv->GetBinContent(ti-1,ei);
-	  sp2 = Nv->GetBinContent(ti,ei);
-	  sp0 = (sp2-sp1)/m_TimeBinWidth * dt0 + sp2;
-	  sp->SetBinContent(ei,sp0);
-	}
+      const double *prev = Nv.Row(ti-1);
+      for(int ei = 0; ei < ne; ei++)
+	out[ei] = (row[ei]-prev[ei])/m_TimeBinWidth * dt0 + row[ei];
     } 
   else 
-    for(int ei = 1; ei <= ne; ei++)
-      {
-	sp->SetBinContent(ei,Nv->GetBinContent(ti,ei));
-      }
-  return sp; //ph
+    for(int ei = 0; ei < ne; ei++)
+      out[ei] = row[ei];
 }
 
 TH1D *SpectObj::GetTimes(double en)
 {
-  if (en == 0.0) return times;
-  int ei = Nv->GetYaxis()->FindBin(en);
-
-  TH1D *lc = CloneTimes();
-
-  for(int ti = 1; ti <= nt; ti++)
-    lc->SetBinContent(ti,Nv->GetBinContent(ti,ei));
-  return lc; //ph
+  if (en == 0.0) 
+    {
+      if(!times) times = CloneTimes();
+      return times;
+    }
+  int ei = Nv.GetEnergyAxis().FindBin(en);
+  std::vector<double> lc;
+  Nv.LightCurve(ei,ei,lc);
+  return MakeHistogram(Nv.GetTimeAxis(), &lc); //ph
 }
 
 //////////////////////////////////////////////////
 TH1D *SpectObj::Integral_E(double e1, double e2)
 {
-  int ei1 = Nv->GetYaxis()->FindBin(e1);
-  int ei2 = Nv->GetYaxis()->FindBin(e2); 
+  int ei1 = Nv.GetEnergyAxis().FindBin(e1);
+  int ei2 = Nv.GetEnergyAxis().FindBin(e2); 
   return Integral_E(ei1,ei2);
 }
 
 TH1D *SpectObj::Integral_E(int ei1, int ei2)
 {
-  //TH1D *ts = (TH1D*) times->Clone();
-  //  ts->SetName("ts");  
-  TH1D *ts = CloneTimes();
-  for(int i = 1; i<=nt; i++)
-    ts->SetBinContent(i,Nv->Integral(i,i,ei1,ei2));
-  return ts; //ph
+  std::vector<double> lc;
+  Nv.LightCurve(ei1,ei2,lc);
+  return MakeHistogram(Nv.GetTimeAxis(), &lc); //ph
 }
 
 double SpectObj::Integral_E(TH1* Sp, double e1, double e2)
@@ -300,42 +328,34 @@ double SpectObj::Integral_E(TH1* Sp, int ei1, int ei2)
 TH1D *SpectObj::Integral_T(double t1, double t2, double en)
 {
   //nv is in ph
-  int ti1 = Nv->GetXaxis()->FindBin(t1);
-  int ti2 = Nv->GetXaxis()->FindBin(t2);
-  int ei  = TMath::Max(1,Nv->GetYaxis()->FindBin(en));
+  int ti1 = Nv.GetTimeAxis().FindBin(t1);
+  int ti2 = Nv.GetTimeAxis().FindBin(t2);
+  int ei  = TMath::Max(1,Nv.GetEnergyAxis().FindBin(en));
   return Integral_T(ti1,ti2,ei); //ph
 }
 
 TH1D *SpectObj::Integral_T(double t1, double t2, double e1, double e2)
 {
   //nv is in ph
-  int ti1 = Nv->GetXaxis()->FindBin(t1);
-  int ti2 = Nv->GetXaxis()->FindBin(t2);
-  int ei1  = Nv->GetYaxis()->FindBin(e1);
-  int ei2  = Nv->GetYaxis()->FindBin(e2);
+  int ti1 = Nv.GetTimeAxis().FindBin(t1);
+  int ti2 = Nv.GetTimeAxis().FindBin(t2);
+  int ei1  = Nv.GetEnergyAxis().FindBin(e1);
+  int ei2  = Nv.GetEnergyAxis().FindBin(e2);
   return Integral_T(ti1,ti2,ei1,ei2); //ph
 }
 
 TH1D *SpectObj::Integral_T(int ti1, int ti2, int e1)
 {
-  TH1D *en = CloneSpectrum();
-  en->Scale(0.0);
-  
-  for(int i = e1; i<=ne; i++)
-    {
-      en->SetBinContent(i,Nv->Integral(ti1,ti2,i,i));
-    }
-  return en; // ph
-  // delete en;
+  return Integral_T(ti1,ti2,e1,ne); // ph
 }
 
 TH1D *SpectObj::Integral_T(int ti1, int ti2, int e1, int e2)
 {
-  TH1D *en = CloneSpectrum();
-  en->Scale(0.0);
-  for(int i = e1; i<=e2; i++)
-    en->SetBinContent(i,Nv->Integral(ti1,ti2,i,i));
-  return en; // ph
+  std::vector<double> sp;
+  Nv.Spectrum(ti1,ti2,sp);
+  for(int i = 0; i <= ne; i++)
+    if(i < e1 || i > e2) sp[i] = 0.0;
+  return MakeHistogram(Nv.GetEnergyAxis(), &sp); // ph
 }
 
 double SpectObj::Integral_T(TH1* Pt, double t1, double t2)
@@ -356,164 +376,214 @@ double SpectObj::Integral_T(TH1* Pt, int ti1, int ti2)
 void SpectObj::ComputeProbability(double enph)
 {
   ProbabilityIsComputed=true;
-  TH1D *pt = Integral_E(enph,emax); //ph
+  int ei1 = Nv.GetEnergyAxis().FindBin(enph);
+  int ei2 = Nv.GetEnergyAxis().FindBin(emax);
+  // Indexed as the time bins of Nv: 0 and nt+1 are the (empty) under/overflow.
+  Nv.LightCurve(ei1,ei2,Probability);
+  for(int ti = 1; ti <= nt; ti++)
+    {
+      Probability[ti] += Probability[ti-1]; //ph
+    }
+}
+
+//////////////////////////////////////////////////
+void SpectObj::ComputeSampler()
+{
+  // Summed-area table of Nv, built once. The number of photons in any
+  // rectangle of time and energy bins is then a difference of four entries.
+  SamplerIsComputed = true;
+  const int stride = ne+1;
+  m_CumulativeNv.assign((nt+1)*stride, 0.0);
   for(int ti = 1; ti <= nt; ti++)
     {
-      Probability->SetBinContent(ti,Integral_T(pt,0,ti)); //ph
+      const double *nv   = Nv.Row(ti);
+      const double *prev = &m_CumulativeNv[(ti-1)*stride];
+      double *cum        = &m_CumulativeNv[ti*stride];
+      double row = 0.0;
+      for(int ei = 1; ei <= ne; ei++)
+	{
+	  row += nv[ei-1]; //ph
+	  cum[ei] = prev[ei] + row;
+	}
     }
-  delete pt;
+}
+
+double SpectObj::SampleEnergy(int ti1, int ti2, int ei)
+{
+  // Same draw as Integral_T(ti1,ti2,ei)->GetRandom(), without building the histogram:
+  // the energy CDF of the time window is the difference of two rows of the table.
+  if(!SamplerIsComputed)
+    ComputeSampler();
+  ti1 = TMath::Max(ti1,1);
+  ti2 = TMath::Min(ti2,nt);
+  ei  = TMath::Min(TMath::Max(ei,1),ne);
+  if(ti2 < ti1) return 0.0;
+  
+  const int stride = ne+1;
+  return SampleBins(Nv.GetEnergyAxis(), &m_CumulativeNv[ti2*stride], &m_CumulativeNv[(ti1-1)*stride], ei-1);
 }
 
 //////////////////////////////////////////////////
 photon SpectObj::GetPhoton(double t0, double enph)
 {
-  //  photon ph;
-  int ei  = TMath::Max(1,Nv->GetYaxis()->FindBin(enph));
+  if(GetPhotons(t0, t0, enph, &ph, 1) == 0)
+    {
+      // The burst is over: return the end marker, > 1 year later.
+      ph.time   = 1.0e8;
+      ph.energy = enph;
+    }
+  return ph;
+}
+
+int SpectObj::GetPhotons(double t0, double tstop, double enph, photon * buffer, int n)
+{
+  if (sourceType != 0 && sourceType != 1)
+    throw std::runtime_error("SpectObj::GetPhotons: unknown source type");
+  
+  int ei  = TMath::Max(1,Nv.GetEnergyAxis().FindBin(enph));
   
   if(!ProbabilityIsComputed)
     ComputeProbability(enph);
   
-  if (sourceType == 0 ) // Transient
+  int count = 0;
+  photon next = ph;
+  while(count < n)
     {
-      double time   = 1.0e8; // > 1 year!
-      double energy =  enph;
+      // Once the burst is over only the end marker is returned, with no draws.
+      bool over = (sourceType == 0 && t0 > m_Tmax);
+      if (sourceType == 0 ) // Transient
+	next = NextTransientPhoton(t0, enph, ei);
+      else //Periodic //Max
+	next = NextPeriodicPhoton(t0, ei);
       
-      if(t0 > m_Tmax)
+      if(DEBUG)  std::cout<< " T0 =  ("<<t0<<"), Next  " << next.time << " Energy  (KeV) " << next.energy << std::endl;
+      t0 = next.time;
+      if (over || m_z == 0 || m_tau == 0 || m_SpRandGen->Uniform() < std::exp(-(*m_tau)(next.energy/1000.0, m_z)))
 	{
-	  ph.time   = time;
-	  ph.energy = energy;
-	  return ph;
+	  // The end marker of a transient is not a photon: stop before it.
+	  if(sourceType == 0 && next.time > m_Tmax) break;
+	  buffer[count++] = next;
+	  if(t0 >= tstop) break;
 	}
-      
-      int t1 = Probability->FindBin(t0);
-      int t2 = t1;
-      double dt0 = t0 - Probability->GetBinCenter(t1);
-      double dP0 = 0;
-      double myP = m_SpRandGen->Uniform(0.9,1.1);
+      else if(DEBUG)  std::cout<< "Absorbed"<< std::endl;
+    }
+  if(count > 0) ph = buffer[count-1];
+  return count;
+}
 
-      if(dt0>0 && t1<nt)
-	{
-	  dP0 = (Probability->GetBinContent(t1+1) - Probability->GetBinContent(t1))*dt0/m_TimeBinWidth;
-	}
-      else if(dt0<0 && t1>1)
-	{
-	  dP0 = (Probability->GetBinContent(t1) - Probability->GetBinContent(t1-1))*dt0/m_TimeBinWidth;
-	}
-      double P0  = Probability->GetBinContent(t1) + dP0;
-      
-      while(Probability->GetBinContent(t2) < P0 + myP && t2 < nt)
-	{
-	  t2++;
-	}
-      /*
-      if(DEBUG)
-	{
-	  std::cout<<Probability->GetBinCenter(t1)<<" "<<Probability->GetBinCenter(t2-1)<<" "<<Probability->GetBinCenter(t2)<<" , "
-		   <<Probability->GetBinContent(t2-1)- Probability->GetBinContent(t1)<<" "
-		   <<Probability->GetBinContent(t2) - Probability->GetBinContent(t1)<<std::endl;
-	}
-      */
-      if(t2 < nt) // the burst has finished  dp < 1 or dp >=1
-	{
-	  double dtf = (P0 + myP - Probability->GetBinContent(t2-1))/ 
-	    (Probability->GetBinContent(t2) - Probability->GetBinContent(t2-1))*m_TimeBinWidth;
-      	  time    = Probability->GetBinCenter(t2-1)+dtf;
-	  TH1D *integral = Integral_T(t1,t2,ei);
-	  energy  = integral->GetRandom();
-	  delete integral;
-	}
-      
-      ph.time   = time;
-      ph.energy = energy;
-      //      delete P;  
-      
-    } 
-  else if (sourceType == 1) //Periodic //Max
+photon SpectObj::NextTransientPhoton(double t0, double enph, int ei)
+{
+  photon next;
+  next.time   = 1.0e8; // > 1 year!
+  next.energy = enph;
+  
+  if(t0 > m_Tmax) return next;
+  
+  const std::vector<double> & P = Probability;
+  int t1 = Nv.GetTimeAxis().FindBin(t0);
+  int t2 = t1;
+  double dt0 = t0 - Nv.GetTimeAxis().GetBinCenter(t1);
+  double dP0 = 0;
+  double myP = m_SpRandGen->Uniform(0.9,1.1);
+  
+  if(dt0>0 && t1<nt)
     {
-      m_z=0.0;
+      dP0 = (P[t1+1] - P[t1])*dt0/m_TimeBinWidth;
+    }
+  else if(dt0<0 && t1>1)
+    {
+      dP0 = (P[t1] - P[t1-1])*dt0/m_TimeBinWidth;
+    }
+  double P0  = P[t1] + dP0;
+  
+  while(P[t2] < P0 + myP && t2 < nt)
+    {
+      t2++;
+    }
+  
+  if(t2 < nt) // the burst has finished  dp < 1 or dp >=1
+    {
+      double dtf = (P0 + myP - P[t2-1])/(P[t2] - P[t2-1])*m_TimeBinWidth;
+      next.time   = Nv.GetTimeAxis().GetBinCenter(t2-1)+dtf;
+      next.energy = SampleEnergy(t1,t2,ei);
+    }
+  return next;
+}
 
-      if (!PeriodicSpectrumIsComputed)
+photon SpectObj::NextPeriodicPhoton(double t0, int ei)
+{
+  m_z=0.0;
+  
+  if (!PeriodicSpectrumIsComputed)
+    {
+      // Cumulative spectrum above enph and light curve, in the bins of Nv
+      std::vector<double> sp;
+      Nv.Spectrum(1,nt,sp);
+      PeriodicSpectrum.assign(ne+1,0.0);
+      for (int e = ei; e <= ne; e++)
+	PeriodicSpectrum[e] = PeriodicSpectrum[e-1] + sp[e];
+
+      //Integral over energies of interest.
+      std::vector<double> lc;
+      Nv.LightCurve(ei,ne,lc); //ph
+      PeriodicLightCurve.assign(nt+1,0.0);
+
+      //Compute also mean flux over bins
+      m_meanRate=0;
+
+      for (int tt=1; tt <= nt; tt++)
 	{
-	  PeriodicSpectrum = Integral_T(1,nt,ei);
-
-	  //Integral over energies of interest.
-	  PeriodicLightCurve = Integral_E(ei,Nv->GetYaxis()->FindBin(emax)); //ph
-	  PeriodicLightCurve->Scale(1./m_TimeBinWidth);
-
-	  //Compute also mean flux over bins
-	  m_meanRate=0;
-
-	  for (int tt=0; tt < nt; tt++)
- 	    {
-	      m_meanRate = m_meanRate + PeriodicLightCurve->GetBinContent(tt+1);
-	    }
-	  m_meanRate=m_meanRate/nt;
-	  // std::cout << "***mF is " << m_meanRate*1e-4/m_AreaDetector << std::endl;
-	  // std::cout << "***mR is " << m_meanRate << std::endl;
-	   
-	  //Normalize PeriodicSpectrum
-	  //int binT0 = Nv->GetXaxis()->FindBin(0.);
-	  //int binTmax = Nv->GetXaxis()->FindBin(m_Tmax);
-   	  //	  double TotalCounts = PeriodicLightCurve->Integral(binT0,binTmax);
-	  //      PeriodicLightCurve->Scale(1./TotalCounts);
-
-	  PeriodicSpectrumIsComputed = true;
+	  PeriodicLightCurve[tt] = PeriodicLightCurve[tt-1] + lc[tt];
+	  m_meanRate = m_meanRate + lc[tt]/m_TimeBinWidth;
 	}
-
-
-      //Extract energyfrom Profile.
-      ph.energy = PeriodicSpectrum->GetRandom();
-
-      double InternalTime = t0 - Int_t(t0/m_Tmax)*m_Tmax; // InternalTime is t0 reduced to a period
-        
-      double deltaTPoisson =  (1./m_FluxFactor)*(-log(1.-CLHEP::RandFlat::shoot(1.0))/m_meanRate); //interval according to Poisson statistics
-      int deltaPer = Int_t((deltaTPoisson - (m_Tmax-InternalTime))/m_Tmax); //number of period up to next photon
-      //Computes PerResid ,i.e. the residual time from deltaTPoisson
-      //after removing the time up to the beginning of the period that contains the next photon  
-      double PerResid = deltaTPoisson - deltaPer*m_Tmax - (m_Tmax-InternalTime); // Residual of
-      //Time added by hand to be compatible with the lightcurve
-      double InternalDelta =  PeriodicLightCurve->GetRandom();
-
-      ph.time = t0 + deltaTPoisson - PerResid + InternalDelta;
-
-      //Warning:check for extremely low sources, if it is ok.It should be ok, but we need a test
-    
+      m_meanRate=m_meanRate/nt;
+      
+      PeriodicSpectrumIsComputed = true;
     }
   
-  if(DEBUG)  std::cout<< " T0 =  ("<<t0<<"), Next  " << ph.time << " Energy  (KeV) " << ph.energy << std::endl;
-  if (m_z == 0 || m_tau == 0 || m_SpRandGen->Uniform() < std::exp(-(*m_tau)(ph.energy/1000.0, m_z)))
-    return ph;
-  else
-    {
-      if(DEBUG)  std::cout<< "Absorbed"<< std::endl;
-      return GetPhoton( ph.time, enph);
-    }
+  photon next;
+  //Extract energyfrom Profile.
+  next.energy = SampleBins(Nv.GetEnergyAxis(), &PeriodicSpectrum[0], 0, ei-1);
+  
+  double InternalTime = t0 - Int_t(t0/m_Tmax)*m_Tmax; // InternalTime is t0 reduced to a period
+  
+  double deltaTPoisson =  (1./m_FluxFactor)*(-log(1.-CLHEP::RandFlat::shoot(1.0))/m_meanRate); //interval according to Poisson statistics
+  int deltaPer = Int_t((deltaTPoisson - (m_Tmax-InternalTime))/m_Tmax); //number of period up to next photon
+  //Computes PerResid ,i.e. the residual time from deltaTPoisson
+  //after removing the time up to the beginning of the period that contains the next photon  
+  double PerResid = deltaTPoisson - deltaPer*m_Tmax - (m_Tmax-InternalTime); // Residual of
+  //Time added by hand to be compatible with the lightcurve
+  double InternalDelta =  SampleBins(Nv.GetTimeAxis(), &PeriodicLightCurve[0], 0, 0);
+  
+  next.time = t0 + deltaTPoisson - PerResid + InternalDelta;
+  
+  //Warning:check for extremely low sources, if it is ok.It should be ok, but we need a test
+  return next;
 }
 
 double SpectObj::GetFluence(double BL, double BH)
 {
   if(BH<=0) BH = emax;
-  int ei1 = Nv->GetYaxis()->FindBin(TMath::Max(emin,BL));
-  int ei2 = Nv->GetYaxis()->FindBin(TMath::Min(emax,BH));
+  const SpectAxis &energies = Nv.GetEnergyAxis();
+  int ei1 = TMath::Max(1,energies.FindBin(TMath::Max(emin,BL)));
+  int ei2 = TMath::Min(ne,energies.FindBin(TMath::Min(emax,BH)));
+  std::vector<double> sp;
+  Nv.Spectrum(1,nt,sp);
   double F=0.0;
-  double en;
   for (int ei = ei1; ei<=ei2; ei++)
     {
-      en   = Nv->GetYaxis()->GetBinCenter(ei);
-      for(int ti = 1; ti<=nt; ti++)
-	{
-	  F+= Nv->GetBinContent(ti, ei)*en;//[keV]
-	}  
+      F+= sp[ei]*energies.GetBinCenter(ei);//[keV]
     }
   return F*1.0e-7/(erg2meV*m_AreaDetector); //erg/cm²
-  //  return Nv->Integral(0,nt,ei1,ei2,"width")*1.0e-7/(m_TimeBinWidth*erg2meV)/m_AreaDetector; //erg/cm²
 }
 
 double SpectObj::GetPeakFlux(double BL, double BH, double AccumulationTime)
 {
   if(BH<=0) BH = emax;
-  int ei1 = Nv->GetYaxis()->FindBin(TMath::Max(emin,BL));
-  int ei2 = Nv->GetYaxis()->FindBin(TMath::Min(emax,BH));
+  int ei1 = Nv.GetEnergyAxis().FindBin(TMath::Max(emin,BL));
+  int ei2 = Nv.GetEnergyAxis().FindBin(TMath::Min(emax,BH));
+  std::vector<double> lc;
+  Nv.LightCurve(ei1,ei2,lc); //[ph]
   
   // 256 ms comes from (BONNELL et al. 1997, Apj.)
   double PF=0.0;
@@ -522,16 +592,10 @@ double SpectObj::GetPeakFlux(double BL, double BH, double AccumulationTime)
   
   for(int ti = 1; ti <= nt; ti++)
     {
-      double PF_t=0.0;
       acc_time +=m_TimeBinWidth;
-      for (int ei = ei1; ei<=ei2; ei++)
-	{
-	  PF_t += Nv->GetBinContent(ti, ei); //[ph]
-	}
-      
       if(acc_time <= AccumulationTime && ti < nt)
       {
-	PF_acc += PF_t;
+	PF_acc += lc[ti];
       }
       else
       {
@@ -539,7 +603,6 @@ double SpectObj::GetPeakFlux(double BL, double BH, double AccumulationTime)
 	acc_time=0.0;
 	PF_acc   = 0.0;
       }
-      //PF = TMath::Max(PF,PF_t); //[ph]
     }
   
   return PF*1e-4/(m_AreaDetector); //ph/cm²/s
@@ -552,7 +615,7 @@ void SpectObj::ScaleAtBATSE(double fluence)
   double BATSEL = 20.0;    //20 keV
   double BATSEH = 1.0e+3;  // 1 MeV
   double norm = GetFluence(BATSEL,BATSEH);//KeV/cm²
-  Nv->Scale(fluence/norm);
+  Nv.Scale(fluence/norm);
 }
 
 
@@ -560,23 +623,26 @@ double SpectObj::GetT90(double BL, double BH)
 {
   if(BL<emin) BL = emin;
   if(BH<=0) BH = emax;
-  TH1D* LC     = Integral_E(BL,BH); //ph
-  LC->Scale(1.0/LC->Integral());
+  const SpectAxis &times = Nv.GetTimeAxis();
+  std::vector<double> LC;
+  Nv.LightCurve(Nv.GetEnergyAxis().FindBin(BL),Nv.GetEnergyAxis().FindBin(BH),LC); //ph
+  double norm = 0.0;
+  for(int ti = 1; ti <= nt; ti++) norm += LC[ti];
+  if(norm <= 0) return 0.0;
   int i=1;
-  double inte = LC->GetBinContent(i);
-  while(inte <= 0.05) 
+  double inte = LC[i]/norm;
+  while(inte <= 0.05 && i <= nt) 
     {
-      inte += LC->GetBinContent(i+1);
+      inte += LC[i+1]/norm;
       i++;
     }  
-  double T05 = TMath::Max(0.0,LC->GetBinCenter(i));
-  while(inte <= 0.95) 
+  double T05 = TMath::Max(0.0,times.GetBinCenter(i));
+  while(inte <= 0.95 && i <= nt) 
     {
-      inte += LC->GetBinContent(i+1);
+      inte += LC[i+1]/norm;
       i++;
     }  
-  double T95 = LC->GetBinCenter(i);  
-  delete LC;
+  double T95 = times.GetBinCenter(i);  
   return T95-T05;
 }
 
@@ -599,9 +665,14 @@ TH1D *SpectObj::N(TH1D *EN)
 double SpectObj::flux(double time, double enph)
 {
   if (time >= m_Tmax) return 1.0e-6;
-  TH1D* fl = GetSpectrum(time);    //ph
-  double integral = Integral_E(fl,enph,emax)/m_TimeBinWidth; //ph/s
-  delete fl;
+  if (time == 0.0) return 0.0; // as GetSpectrum(0.0), which is empty
+  std::vector<double> fl;
+  InterpolateSpectrum(time, fl);    //ph
+  int ei1 = TMath::Max(1,Nv.GetEnergyAxis().FindBin(enph));
+  double integral = 0.0;
+  for(int ei = ei1; ei <= ne; ei++)
+    integral += fl[ei];
+  integral /= m_TimeBinWidth; //ph/s
   return integral/m_AreaDetector;//ph/m2/s
 }
 
@@ -10,16 +10,29 @@
 #ifndef eblAtten_EblAtten_h
 #define eblAtten_EblAtten_h
 
+#include <cstddef>
 #include <map>
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace IRB {
 
+class TauGrid;
+class TauModel;
+
 /**
  * @class EblAtten
  * @brief Function object wrapper to Hays/McEnery code (in IRB_routines.cxx)
  * that calculates EBL optical depth as a function of energy and redshift
  * for four different models.
+ *
+ * The underlying model is loaded when the object is constructed, and
+ * the models and grids are immutable once built, so the const methods
+ * may be called from several threads at once.  useGrid() should be
+ * called before the object is shared.
+ *
  * @author J. Chiang
  *
  * $Header$
@@ -43,15 +56,60 @@ public:
    /// @param Source redshift
    float operator()(float energy, float redshift) const;
 
+   /// Optical depths for an array of photon energies at one redshift.
+   /// The redshift interpolation is done once for the whole array.
+   /// @param energies Photon energies (MeV)
+   /// @param n Number of energies
+   /// @param redshift Source redshift
+   /// @param tau Output optical depths, n values
+   void operator()(const float * energies, size_t n, float redshift,
+                   float * tau) const;
+
+   void operator()(const std::vector<float> & energies, float redshift,
+                   std::vector<float> & tau) const;
+
+   /// Optical depths for (energy (MeV), redshift) pairs.  Consecutive
+   /// pairs with the same redshift are evaluated together.
+   void operator()(const std::vector< std::pair<float, float> > & points,
+                   std::vector<float> & tau) const;
+
    EblModel model() const {
       return m_model;
    }
 
+   /// Evaluate the optical depths by bilinear interpolation, in
+   /// log(energy) and redshift, of the model precomputed on a grid
+   /// with 64 points per decade in energy and a spacing of 0.01 in
+   /// redshift.  The grids are shared by all EblAtten objects using the
+   /// same model.  Grid cells where the interpolated exp(-tau) differs
+   /// from the model by more than 1e-3 at the cell centre or edge
+   /// midpoints, and points outside of the model range, use the model
+   /// directly.  At the steps and kinks of the models the difference can
+   /// reach 2e-3.  Grid mode is also enabled for every EblAtten object
+   /// if the EBL_TAU_GRID environment variable is set; if its value is
+   /// not empty, it is the directory in which the grids are cached.
+   /// @param cacheFile Binary file in which to cache the grid for this
+   ///        model.  It is read if it matches the model and grid, and
+   ///        written otherwise.
+   void useGrid(const std::string & cacheFile="");
+
+   /// @return Largest difference in exp(-tau) between the grid and the
+   /// model found at the grid test points, or zero if grid mode is off.
+   float maxGridError() const;
+
 private:
 
    EblModel m_model;
 
-   static std::map<EblModel, std::string> s_model_Ids;
+   /// The model, shared by all EblAtten objects using it.
+   const TauModel * m_tau;
+
+   /// Precomputed grid used in grid mode, or zero.
+   const TauGrid * m_grid;
+
+   const TauModel & tauFunction() const;
+
+   static const std::map<EblModel, std::string> & modelIds();
 
 };
 
@@ -11,42 +11,80 @@
 
 #include <cstdlib>
 #include <cmath>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <algorithm>
+#include <fstream>
+#include <sstream>
 #include <stdexcept>
 
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "facilities/Util.h"
 #include "st_facilities/Util.h"
 #include "AsciiTableModel.h"
 
-namespace IRB {
-
-AsciiTableModel::AsciiTableModel(const std::string & infile) 
-   : m_infile(infile) {
-   read_ascii_table();
-}
+namespace {
+/// Layout of the binary tables: this header, followed by the nz
+/// redshifts, the ne energies, and the ne*nz optical depths, nz for each
+/// energy, all as native floats.
+   struct BinaryHeader {
+      char magic[8];
+      unsigned int byteOrder;
+      unsigned int ne;
+      unsigned int nz;
+      unsigned int reserved;
+   };
+   const char s_magic[8] = {'E', 'B', 'L', 'T', 'A', 'B', '0', '1'};
+   const unsigned int s_byteOrder(0x01020304);
 
-float AsciiTableModel::value(float energy, float redshift) const {
-   if (redshift < m_redshifts.front() || energy <= m_energies.front()) {
-      return 0;
+   bool isNewer(const std::string & file1, const std::string & file2) {
+      struct stat stat1, stat2;
+      if (stat(file1.c_str(), &stat1) != 0) {
+         return false;
+      }
+      if (stat(file2.c_str(), &stat2) != 0) {
+         return true;
+      }
+      return stat1.st_mtime >= stat2.st_mtime;
    }
+}
 
-   size_t e_index = std::lower_bound(m_energies.begin(), m_energies.end(),
-                                     energy) - m_energies.begin() - 1;
+namespace IRB {
 
+AsciiTableModel::AsciiTableModel(const std::string & infile,
+                                 float energyScale) 
+   : m_infile(infile), m_energyScale(energyScale), m_ne(0), m_nz(0),
+     m_energies(0), m_redshifts(0), m_tau_array(0), m_map(0), m_mapSize(0) {
+   std::string binfile(binaryFile(infile));
+   if (!isNewer(binfile, infile) || !map_binary_table(binfile)) {
+      read_ascii_table();
+   }
+}
 
-   if (e_index + 1  > m_energies.size() - 1) {
-      throw std::runtime_error("Selected energy outside range of "
-                               + m_infile);
+AsciiTableModel::~AsciiTableModel() {
+#ifndef WIN32
+   if (m_map) {
+      munmap(m_map, m_mapSize);
    }
-   size_t z_index = std::lower_bound(m_redshifts.begin(), m_redshifts.end(),
-                                     redshift) - m_redshifts.begin() -1 ;
+#endif
+}
 
-   if (z_index + 1 > m_redshifts.size() - 1) {
-      throw std::runtime_error("Selected redshift outside range of "
-                               + m_infile);
+float AsciiTableModel::value(float energy, float redshift) const {
+   energy *= m_energyScale;
+   if (redshift < m_redshifts[0] || energy <= m_energies[0]) {
+      return 0;
    }
 
+   size_t e_index = energy_index(energy);
+   size_t z_index = redshift_index(redshift);
 
    float tau1 = tau_of_e(redshift, e_index, z_index);
    float tau2 = tau_of_e(redshift, e_index+1, z_index);
@@ -62,33 +100,247 @@ float AsciiTableModel::value(float energy, float redshift) const {
    return tau;
 }
 
+void AsciiTableModel::values(const float * energies, size_t n,
+                             float redshift, float * tau,
+                             double energyScale) const {
+   if (redshift < m_redshifts[0]) {
+      std::fill(tau, tau + n, 0.f);
+      return;
+   }
+   size_t z_index(0);
+   bool have_z_index(false);
+
+   // In table interval k, tau(E) = a*exp(b*(log(E) - log(E_k))) at this
+   // redshift, which is the log-log interpolation done in value().  The
+   // coefficients are those of the interval of the previous energy, and
+   // are recomputed only when the interval changes.
+   size_t coeff_index(m_ne);
+   float a(0), b(0);
+
+   // Process the energies in chunks so that the log and exp loops, which
+   // have no branches, can be vectorized.
+   const size_t chunk(256);
+   float arg[chunk];
+   float scale[chunk];
+   size_t e_index(0);
+   for (size_t i0(0); i0 < n; i0 += chunk) {
+      size_t m(std::min(chunk, n - i0));
+      const float * energy(energies + i0);
+      for (size_t j(0); j < m; j++) {
+         scale[j] = float(energy[j]*energyScale)*m_energyScale;
+         arg[j] = std::log(scale[j]);
+      }
+      for (size_t j(0); j < m; j++) {
+         float my_energy(scale[j]);
+         if (my_energy <= m_energies[0]) {
+            scale[j] = 0;
+            arg[j] = 0;
+            continue;
+         }
+         // Consecutive energies are often in the same interval.
+         if (!(my_energy > m_energies[e_index] 
+               && my_energy <= m_energies[e_index + 1])) {
+            e_index = energy_index(my_energy);
+         }
+         if (!have_z_index) {
+            z_index = redshift_index(redshift);
+            have_z_index = true;
+         }
+         if (e_index != coeff_index) {
+            float tau1 = tau_of_e(redshift, e_index, z_index);
+            float tau2 = tau_of_e(redshift, e_index+1, z_index);
+            if (tau1 == 0 || tau2 == 0) {
+               a = 0;
+               b = 0;
+            } else {
+               a = tau1;
+               b = ( std::log(tau2/tau1)
+                     /(m_logEnergies[e_index+1] - m_logEnergies[e_index]) );
+            }
+            coeff_index = e_index;
+         }
+         scale[j] = a;
+         arg[j] = b*(arg[j] - m_logEnergies[e_index]);
+      }
+      for (size_t j(0); j < m; j++) {
+         tau[i0 + j] = scale[j]*std::exp(arg[j]);
+      }
+   }
+}
+
+size_t AsciiTableModel::energy_index(float energy) const {
+   size_t e_index = std::lower_bound(m_energies, m_energies + m_ne,
+                                     energy) - m_energies - 1;
+   if (e_index + 1  > m_ne - 1) {
+      throw std::runtime_error("Selected energy outside range of "
+                               + m_infile);
+   }
+   return e_index;
+}
+
+size_t AsciiTableModel::redshift_index(float redshift) const {
+   size_t z_index = std::lower_bound(m_redshifts, m_redshifts + m_nz,
+                                     redshift) - m_redshifts -1 ;
+   if (redshift == m_redshifts[0]) {
+      // lower_bound gives the first node itself; use the first interval
+      // rather than indexing before the start of the table.
+      z_index = 0;
+   }
+   if (z_index + 1 > m_nz - 1) {
+      throw std::runtime_error("Selected redshift outside range of "
+                               + m_infile);
+   }
+   return z_index;
+}
+
 void AsciiTableModel::read_ascii_table() {
+   size_t ne, nz;
+   parse_ascii_table(m_infile, m_data, ne, nz);
+   set_table(&m_data[0], ne, nz);
+}
+
+void AsciiTableModel::parse_ascii_table(const std::string & infile,
+                                        std::vector<float> & data,
+                                        size_t & ne, size_t & nz) {
    std::vector<std::string> lines;
    std::string skip;
    bool cleanLines;
-   st_facilities::Util::readLines(m_infile, lines, skip="", cleanLines=true);
+   st_facilities::Util::readLines(infile, lines, skip="", cleanLines=true);
 
    // Read the redshift values from the first line.
    std::vector<std::string> tokens;
    facilities::Util::stringTokenize(lines[0].substr(16), ",", tokens);
-   m_redshifts.clear();
+   std::vector<float> redshifts;
    for (size_t i(0); i < tokens.size(); i++) {
-      m_redshifts.push_back(std::atof(tokens[i].c_str()));
+      redshifts.push_back(std::atof(tokens[i].c_str()));
    }
    // Read in the energies and tau values.
-   m_energies.clear();
-   m_tau_array.clear();
+   std::vector<float> energies;
+   std::vector<float> tau_values;
    for (size_t i(1); i < lines.size(); i++) {
       facilities::Util::stringTokenize(lines[i], "\t ", tokens);
-      if (tokens.size() != m_redshifts.size() + 1) {
+      if (tokens.size() != redshifts.size() + 1) {
          continue;
       }
-      m_energies.push_back(std::atof(tokens[0].c_str()));
-      std::vector<float> tau_values;
+      energies.push_back(std::atof(tokens[0].c_str()));
       for (size_t k(1); k < tokens.size(); k++) {
          tau_values.push_back(std::atof(tokens[k].c_str()));
       }
-      m_tau_array.push_back(tau_values);
+   }
+   data.clear();
+   data.insert(data.end(), redshifts.begin(), redshifts.end());
+   data.insert(data.end(), energies.begin(), energies.end());
+   data.insert(data.end(), tau_values.begin(), tau_values.end());
+   ne = energies.size();
+   nz = redshifts.size();
+}
+
+bool AsciiTableModel::map_binary_table(const std::string & binfile) {
+   BinaryHeader header;
+   std::ifstream input(binfile.c_str(), std::ios::binary);
+   input.read(reinterpret_cast<char *>(&header), sizeof(header));
+   if (!input || std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0
+       || header.byteOrder != s_byteOrder || header.ne < 2 || header.nz < 2) {
+      return false;
+   }
+   size_t ndata(header.nz + header.ne + size_t(header.ne)*header.nz);
+   size_t size(sizeof(header) + ndata*sizeof(float));
+   input.seekg(0, std::ios::end);
+   if (static_cast<size_t>(input.tellg()) != size) {
+      return false;
+   }
+#ifndef WIN32
+   input.close();
+   int fd(open(binfile.c_str(), O_RDONLY));
+   if (fd < 0) {
+      return false;
+   }
+   void * map(mmap(0, size, PROT_READ, MAP_SHARED, fd, 0));
+   close(fd);
+   if (map == MAP_FAILED) {
+      return false;
+   }
+   m_map = map;
+   m_mapSize = size;
+   set_table(reinterpret_cast<const float *>(static_cast<char *>(map)
+                                             + sizeof(header)),
+             header.ne, header.nz);
+#else
+   m_data.resize(ndata);
+   input.seekg(sizeof(header), std::ios::beg);
+   input.read(reinterpret_cast<char *>(&m_data[0]), ndata*sizeof(float));
+   if (!input) {
+      return false;
+   }
+   set_table(&m_data[0], header.ne, header.nz);
+#endif
+   return true;
+}
+
+void AsciiTableModel::set_table(const float * data, size_t ne, size_t nz) {
+   m_ne = ne;
+   m_nz = nz;
+   m_redshifts = data;
+   m_energies = data + nz;
+   m_tau_array = data + nz + ne;
+   m_logEnergies.clear();
+   for (size_t k(0); k < m_ne; k++) {
+      m_logEnergies.push_back(std::log(m_energies[k]));
+   }
+}
+
+std::string AsciiTableModel::binaryFile(const std::string & infile) {
+   std::string::size_type pos(infile.rfind(".dat"));
+   if (pos != std::string::npos && pos + 4 == infile.size()) {
+      return infile.substr(0, pos) + ".bin";
+   }
+   return infile + ".bin";
+}
+
+void AsciiTableModel::writeBinaryTable(const std::string & infile,
+                                       const std::string & outfile) {
+// Always parse the ascii file: an existing binary table may be the
+// output file itself, and may be mapped by this or another process.
+   std::vector<float> data;
+   size_t ne, nz;
+   parse_ascii_table(infile, data, ne, nz);
+   if (ne < 2 || nz < 2 || data.size() != nz + ne + ne*nz) {
+      throw std::runtime_error("AsciiTableModel::writeBinaryTable: "
+                               "invalid table " + infile);
+   }
+   BinaryHeader header;
+   std::memcpy(header.magic, s_magic, sizeof(s_magic));
+   header.byteOrder = s_byteOrder;
+   header.ne = ne;
+   header.nz = nz;
+   header.reserved = 0;
+
+// Write to a temporary file and rename it, so that mappings of the old
+// file stay valid and readers never see a partial table.
+   std::ostringstream tmpFile;
+   tmpFile << outfile << ".tmp";
+#ifndef WIN32
+   tmpFile << getpid();
+#endif
+   std::ofstream output(tmpFile.str().c_str(), std::ios::binary);
+   output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+   output.write(reinterpret_cast<const char *>(&data[0]),
+                data.size()*sizeof(float));
+   output.close();
+   if (!output) {
+      std::remove(tmpFile.str().c_str());
+      throw std::runtime_error("AsciiTableModel::writeBinaryTable: "
+                               "error writing " + outfile);
+   }
+#ifdef WIN32
+// rename does not replace an existing file on Windows.
+   std::remove(outfile.c_str());
+#endif
+   if (std::rename(tmpFile.str().c_str(), outfile.c_str()) != 0) {
+      std::remove(tmpFile.str().c_str());
+      throw std::runtime_error("AsciiTableModel::writeBinaryTable: "
+                               "error renaming " + tmpFile.str()
+                               + " to " + outfile);
    }
 }
 
@@ -96,8 +348,9 @@ float AsciiTableModel::tau_of_e(float redshift, size_t e_index,
                                 size_t z_index) const {
    float tau = ( (redshift - m_redshifts[z_index])
                  /(m_redshifts[z_index+1] - m_redshifts[z_index])
-                 *(m_tau_array[e_index][z_index+1] - m_tau_array[e_index][z_index])
-                 + m_tau_array[e_index][z_index] );
+                 *(m_tau_array[e_index*m_nz + z_index+1]
+                   - m_tau_array[e_index*m_nz + z_index])
+                 + m_tau_array[e_index*m_nz + z_index] );
    return tau;
 }
 
@@ -15,27 +15,100 @@
 #include <string>
 #include <vector>
 
+#include "TauModel.h"
+
 namespace IRB {
 
-class AsciiTableModel {
+/**
+ * @class AsciiTableModel
+ * @brief Optical depths interpolated from a table.  If a binary version
+ * of the table (see writeBinaryTable), at least as recent as the ascii
+ * file, is found next to it, the binary file is memory-mapped and used
+ * directly; otherwise the ascii file is parsed.
+ */
+
+class AsciiTableModel : public TauModel {
 
 public:
 
-   AsciiTableModel(const std::string & infile);
+   /// @param infile Table of optical depths.
+   /// @param energyScale Conversion factor from GeV to the energy units
+   ///        of the table, e.g., 1e3 for tables in MeV.
+   AsciiTableModel(const std::string & infile, float energyScale=1);
+
+   virtual ~AsciiTableModel();
+
+   virtual float value(float energy, float redshift) const;
+
+   virtual void values(const float * energies, size_t n, float redshift,
+                       float * tau, double energyScale=1) const;
+
+   virtual float maxEnergy() const {
+      return m_energies[m_ne - 1]/m_energyScale;
+   }
+
+   virtual float maxRedshift() const {
+      return m_redshifts[m_nz - 1];
+   }
+
+   virtual std::string tableFile() const {
+      return m_infile;
+   }
+
+   /// @return Name of the binary table used in place of an ascii table,
+   /// i.e., the ascii file name with its .dat extension replaced by .bin.
+   static std::string binaryFile(const std::string & infile);
 
-   float value(float energy, float redshift) const;
+   /// Convert an ascii table to the binary format.  The ascii file is
+   /// always parsed, and the output is written to a temporary file that
+   /// is renamed to outfile, so an existing binary table may be replaced
+   /// while it is mapped.
+   static void writeBinaryTable(const std::string & infile,
+                                const std::string & outfile);
 
 private:
 
    std::string m_infile;
-   std::vector<float> m_energies;
-   std::vector<float> m_redshifts;
-   std::vector< std::vector<float> > m_tau_array;
+   float m_energyScale;
+
+   size_t m_ne;
+   size_t m_nz;
+
+   /// Energies, redshifts, and the optical depths, m_nz values for each
+   /// energy.  These point either into m_data or into the mapped file.
+   const float * m_energies;
+   const float * m_redshifts;
+   const float * m_tau_array;
+
+   std::vector<float> m_logEnergies;
+
+   /// Table contents read from an ascii file.
+   std::vector<float> m_data;
+
+   /// Memory-mapped binary table.
+   void * m_map;
+   size_t m_mapSize;
+
+   // Disable copying, since the object may own a mapping.
+   AsciiTableModel(const AsciiTableModel &);
+   AsciiTableModel & operator=(const AsciiTableModel &);
 
    void read_ascii_table();
 
+   static void parse_ascii_table(const std::string & infile,
+                                 std::vector<float> & data,
+                                 size_t & ne, size_t & nz);
+
+   bool map_binary_table(const std::string & binfile);
+
+   void set_table(const float * data, size_t ne, size_t nz);
+
    float tau_of_e(float redshift, size_t e_index, size_t z_index) const;
 
+   size_t energy_index(float energy) const;
+
+   size_t redshift_index(float redshift) const;
+
 };
 
 } // namespace IRB
@@ -8,115 +8,149 @@
  * $Header$
  */
 
+#include <cstdlib>
+
+#include <algorithm>
+#include <mutex>
 #include <sstream>
 
+#include "facilities/commonUtilities.h"
+
 #include "eblAtten/EblAtten.h"
 
+#include "TauGrid.h"
+#include "TauModel.h"
+
 namespace IRB {
 
-std::map<EblModel, std::string> EblAtten::s_model_Ids;
-
-float calcKneiske(float energy, float redshift);
-float calcPrimack05(float energy, float redshift);
-float calcKneiske_HighUV(float energy, float redshift);
-float calcStecker05(float energy, float redshift);
-float calcFranceschini(float energy, float redshift);
-float calcFinke(float energy, float redshift);
-float calcStecker05_FE(float energy, float redshift);
-float calcSalamonStecker(float energy, float redshift);
-float calcGeneric(float energy, float redshift);
-float calcGilmore09(float energy, float redshift);
-float calcGilmore12_fixed(float energy, float redshift);
-float calcGilmore12_fiducial(float energy, float redshift);
-float calcInoue13(float energy, float redshift);
-float calcDominguez11(float energy, float redshift);
-float calcScully14_highOp(float energy, float redshift);
-float calcScully14_lowOp(float energy, float redshift);
-float calcKneiskeDole10(float energy, float redshift);
-float calcKneiskeDole10_CMB(float energy, float redshift);
-float calcHelgasonKashlinsky12(float energy, float redshift);
-
-EblAtten::EblAtten(EblModel model) : m_model(model) {
-   if (s_model_Ids.size() == 0) {
-      s_model_Ids[Kneiske] = "Kneiske et al - Best Fit (2004)";
-      s_model_Ids[Primack05] = "Primack et al (2005)";
-      s_model_Ids[Kneiske_HighUV] = "Kneiske et al - High UV (2004)";
-      s_model_Ids[Stecker05] = "Stecker et al (2006)";
-      s_model_Ids[Franceschini] = "Franceschini (2008)";
-      s_model_Ids[Finke] = "Finke et al. (2009)";
-      s_model_Ids[Gilmore] = "Deprecated (returns Gilmore09 model)";
-      s_model_Ids[Stecker05_FE] = "Stecker et al (2006) - Fast Evolution";
-      s_model_Ids[SalamonStecker] = "Salamon & Stecker (1998) - with metallicity correction";
-      s_model_Ids[Generic] = "Generic representation of tau(E,z) from Justin Finke";
-      s_model_Ids[Gilmore09] = "Gilmore et al (2009)";
-      s_model_Ids[Gilmore12_fixed] = "Gilmore et al (2012) - WMAP5+Fixed";
-      s_model_Ids[Gilmore12_fiducial] = "Gilmore et al (2012) - Evolving Dust";
-      s_model_Ids[Inoue13] = "Inoue et al (2013)";
-      s_model_Ids[Dominguez11] = "Dominguez et al (2011)";
-      s_model_Ids[Scully14_highOp] = "Scully et al (2014) - High Opacity";
-      s_model_Ids[Scully14_lowOp] = "Scully et al (2014) - Low Opacity";
-      s_model_Ids[KneiskeDole10] = "Kneiske & Dole (2010)";
-      s_model_Ids[KneiskeDole10_CMB] = "Kneiske & Dole (2010) - with CMB";
-      s_model_Ids[HelgasonKashlinsky12] = "Helgason & Kashlinsky (2012)";
+/// Model objects for each model ID, implemented in IRB_routines.cxx
+const TauModel & tauModel(EblModel model);
+
+namespace {
+   std::map<EblModel, std::string> makeModelIds() {
+      std::map<EblModel, std::string> ids;
+      ids[Kneiske] = "Kneiske et al - Best Fit (2004)";
+      ids[Primack05] = "Primack et al (2005)";
+      ids[Kneiske_HighUV] = "Kneiske et al - High UV (2004)";
+      ids[Stecker05] = "Stecker et al (2006)";
+      ids[Franceschini] = "Franceschini (2008)";
+      ids[Finke] = "Finke et al. (2009)";
+      ids[Gilmore] = "Deprecated (returns Gilmore09 model)";
+      ids[Stecker05_FE] = "Stecker et al (2006) - Fast Evolution";
+      ids[SalamonStecker] = "Salamon & Stecker (1998) - with metallicity correction";
+      ids[Generic] = "Generic representation of tau(E,z) from Justin Finke";
+      ids[Gilmore09] = "Gilmore et al (2009)";
+      ids[Gilmore12_fixed] = "Gilmore et al (2012) - WMAP5+Fixed";
+      ids[Gilmore12_fiducial] = "Gilmore et al (2012) - Evolving Dust";
+      ids[Inoue13] = "Inoue et al (2013)";
+      ids[Dominguez11] = "Dominguez et al (2011)";
+      ids[Scully14_highOp] = "Scully et al (2014) - High Opacity";
+      ids[Scully14_lowOp] = "Scully et al (2014) - Low Opacity";
+      ids[KneiskeDole10] = "Kneiske & Dole (2010)";
+      ids[KneiskeDole10_CMB] = "Kneiske & Dole (2010) - with CMB";
+      ids[HelgasonKashlinsky12] = "Helgason & Kashlinsky (2012)";
+      return ids;
    }
+
+/// Grids shared by all EblAtten objects in grid mode.  The grids are
+/// immutable once built; the mutex serializes building them.
+   std::map<EblModel, TauGrid *> s_grids;
+   std::mutex s_gridMutex;
+}
+
+const std::map<EblModel, std::string> & EblAtten::modelIds() {
+   static const std::map<EblModel, std::string> ids(makeModelIds());
+   return ids;
+}
+
+EblAtten::EblAtten(EblModel model) : m_model(model), m_tau(0), m_grid(0) {
+   const std::map<EblModel, std::string> & s_model_Ids(modelIds());
    if (s_model_Ids.find(model) == s_model_Ids.end()) {
       std::ostringstream message;
       message << "Invalid model ID: " << model << "\n"
               << "Valid models are \n";
-      std::map<EblModel, std::string>::iterator it;
+      std::map<EblModel, std::string>::const_iterator it;
       for (it = s_model_Ids.begin(); it != s_model_Ids.end(); ++it) {
          message << it->first << " : " << it->second << "\n";
       }
       throw std::runtime_error(message.str());
    }
+// Build the model now, so that it is never initialized from const
+// methods that may be called concurrently.
+   m_tau = &tauModel(model);
+   const char * gridDir(std::getenv("EBL_TAU_GRID"));
+   if (gridDir != 0) {
+      std::string cacheFile;
+      if (std::string(gridDir) != "") {
+         std::ostringstream basename;
+         basename << "eblAtten_tau_grid_" << model << ".bin";
+         cacheFile = facilities::commonUtilities::joinPath(gridDir,
+                                                           basename.str());
+      }
+      useGrid(cacheFile);
+   }
+}
+
+void EblAtten::useGrid(const std::string & cacheFile) {
+   std::lock_guard<std::mutex> lock(s_gridMutex);
+   std::map<EblModel, TauGrid *>::iterator it(s_grids.find(m_model));
+   if (it == s_grids.end()) {
+      TauGrid * grid(new TauGrid(*m_tau, m_model, cacheFile));
+      it = s_grids.insert(std::make_pair(m_model, grid)).first;
+   }
+   m_grid = it->second;
+}
+
+float EblAtten::maxGridError() const {
+   if (m_grid == 0) {
+      return 0;
+   }
+   return m_grid->maxError();
+}
+
+const TauModel & EblAtten::tauFunction() const {
+   if (m_grid) {
+      return *m_grid;
+   }
+   return *m_tau;
 }
 
 float EblAtten::operator()(float energy, float redshift) const {
 // Convert energy from MeV to GeV:
    energy /= 1e3;
-   switch (m_model) {
-   case Kneiske:
-      return calcKneiske(energy, redshift);
-   case Primack05:
-      return calcPrimack05(energy, redshift);
-   case Kneiske_HighUV:
-      return calcKneiske_HighUV(energy, redshift);
-   case Stecker05:
-      return calcStecker05(energy, redshift);
-   case Franceschini:
-      return calcFranceschini(energy, redshift);
-   case Finke:
-      return calcFinke(energy, redshift);
-   case Gilmore:
-      return calcGilmore09(energy, redshift);
-   case Stecker05_FE:
-      return calcStecker05_FE(energy, redshift);
-   case SalamonStecker:
-      return calcSalamonStecker(energy, redshift);
-   case Generic:
-      return calcGeneric(energy, redshift);
-   case Gilmore09:
-      return calcGilmore09(energy, redshift);
-   case Gilmore12_fixed:
-      return calcGilmore12_fixed(energy, redshift);
-   case Gilmore12_fiducial:
-      return calcGilmore12_fiducial(energy, redshift);
-   case Inoue13:
-      return calcInoue13(energy, redshift);
-   case Dominguez11:
-      return calcDominguez11(energy, redshift);
-   case Scully14_highOp:
-      return calcScully14_highOp(energy, redshift);
-   case Scully14_lowOp:
-      return calcScully14_lowOp(energy, redshift);
-   case KneiskeDole10:
-      return calcKneiskeDole10(energy, redshift);
-   case KneiskeDole10_CMB:
-      return calcKneiskeDole10_CMB(energy, redshift);
-   case HelgasonKashlinsky12:
-      return calcHelgasonKashlinsky12(energy, redshift);
+   return tauFunction().value(energy, redshift);
+}
+
+void EblAtten::operator()(const float * energies, size_t n, float redshift,
+                          float * tau) const {
+// One call for all of the energies, so that the redshift interpolation
+// is done once; the model converts them from MeV to GeV.
+   tauFunction().values(energies, n, redshift, tau, 1e-3);
+}
+
+void EblAtten::operator()(const std::vector<float> & energies, float redshift,
+                          std::vector<float> & tau) const {
+   tau.resize(energies.size());
+   if (!energies.empty()) {
+      operator()(&energies[0], energies.size(), redshift, &tau[0]);
+   }
+}
+
+void EblAtten::operator()(const std::vector< std::pair<float, float> > & points,
+                          std::vector<float> & tau) const {
+   tau.resize(points.size());
+   std::vector<float> energies;
+   size_t i(0);
+   while (i < points.size()) {
+// Evaluate each run of points with the same redshift in one call.
+      size_t j(i);
+      energies.clear();
+      for ( ; j < points.size() && points[j].second == points[i].second; j++) {
+         energies.push_back(points[j].first);
+      }
+      operator()(&energies[0], energies.size(), points[i].second, &tau[i]);
+      i = j;
    }
-   return 0;
 }
 
 } // namespace IRB
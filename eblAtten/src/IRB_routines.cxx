@@ -14,178 +14,152 @@
 #include <cmath>
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
 
 #include "facilities/commonUtilities.h"
 
+#include "eblAtten/EblAtten.h"
+
 #include "AsciiTableModel.h"
 #include "Primack05.h"
+#include "TauModel.h"
 
 using namespace std;
 
 namespace IRB {
 
-float calcKneiske(float energy, float redshift);
-float calcPrimack05(float energy, float redshift);
-float calcKneiske_HighUV(float energy, float redshift);
+float calcGeneric (float energy, float redshift);
 float calcStecker05(float energy, float redshift);
 float calcStecker05_FE(float energy, float redshift);
-float calcFranceschini(float energy, float redshift);
-float calcFinke(float energy, float redshift);
-float calcSalamonStecker(float energy, float redshift);
-float calcGeneric (float energy, float redshift);
-float calcGilmore09(float energy, float redshift);
-float calcGilmore12_fixed(float energy, float redshift);
-float calcGilmore12_fiducial(float energy, float redshift);
-float calcInoue13(float energy, float redshift);
-float calcDominguez11(float energy, float redshift);
-float calcScully14_highOp(float energy, float redshift);
-float calcScully14_lowOp(float energy, float redshift);
-float calcKneiskeDole10(float energy, float redshift);
-float calcKneiskeDole10_CMB(float energy, float redshift);
-float calcHelgasonKashlinsky12(float energy, float redshift);
-
-float calcHelgasonKashlinsky12(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_HELGASONandKASHLINSKY_2012.dat");
-   
-   static AsciiTableModel HelgasonKashlinsky12(od_file);
-   return HelgasonKashlinsky12.value(energy, redshift);
-}
-
-
-float calcKneiskeDole10_CMB(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_KNEISKEandDOLE_2010.dat");
-
-   static AsciiTableModel kneiskedole10_cmb(od_file); 
-   return kneiskedole10_cmb.value(energy, redshift);
-}
-
-
-float calcKneiskeDole10(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_KNEISKEandDOLE_2010_noCMB.dat");
-   
-   static AsciiTableModel kneiskedole10(od_file);
-   return kneiskedole10.value(energy, redshift);
-}
-
-float calcScully14_highOp(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_SCULLYetal2014_highOp.dat");
-   
-   static AsciiTableModel scully14_highOp(od_file);
-   return scully14_highOp.value(energy, redshift);
-}
-
-float calcScully14_lowOp(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_SCULLYetal2014_lowOp.dat");
-
-   static AsciiTableModel scully14_lowOp(od_file);
-   return scully14_lowOp.value(energy, redshift);
-}
-
-
-float calcDominguez11(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_DOMINGUEZetal_2011.dat");
-   
-   static AsciiTableModel dominguez11(od_file);
-   return dominguez11.value(energy, redshift);
-}
-
-float calcInoue13(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_INOUEetal_2013.dat");
-   
-   static AsciiTableModel inoue13(od_file);
-   return inoue13.value(energy, redshift);
-}
-
-float calcGilmore09(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_GILMOREetal_2009.dat");
-   
-   static AsciiTableModel gilmore09(od_file);
-   return gilmore09.value(energy, redshift);
-}
 
-float calcGilmore12_fixed(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file = 
-      facilities::commonUtilities::joinPath(datadir, "opdep_fixed_Gilmore2012.dat");
-
-   static AsciiTableModel gilmore_fixed(od_file);
-   /// The Gilmore et al 2012 tables use MeV, so convert back from GeV.
-   return gilmore_fixed.value(energy*1e3, redshift);
-}
-
-float calcGilmore12_fiducial(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file = 
-      facilities::commonUtilities::joinPath(datadir, "opdep_fiducial_Gilmore2012.dat");
-   static AsciiTableModel gilmore_fiducial(od_file);
-   /// The Gilmore et al 2012 tables use MeV, so convert back from GeV.
-   return gilmore_fiducial.value(energy*1e3, redshift);
-}
-
-
-float calcSalamonStecker(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_SalamonStecker98.dat");
-   static AsciiTableModel salamon_stecker(od_file);
-   return salamon_stecker.value(energy, redshift);
-}
+namespace {
 
-float calcFinke(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_Finke_2009.dat");
-   static AsciiTableModel finke(od_file);
-   return finke.value(energy, redshift);  
-}
-
-float calcFranceschini(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_Franceschini_2008.dat");
-   static AsciiTableModel franceschini(od_file);
-   return franceschini.value(energy, redshift);
-}
+/**
+ * @class FunctionModel
+ * @brief TauModel for the parametric models implemented as functions below.
+ */
+class FunctionModel : public TauModel {
+public:
+   FunctionModel(float (*func)(float, float)) : m_func(func) {}
+   virtual float value(float energy, float redshift) const {
+      return m_func(energy, redshift);
+   }
+private:
+   float (*m_func)(float, float);
+};
 
-float calcKneiske(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_KNEISKEetal2004_bestfit.dat");
-   static AsciiTableModel kneiske(od_file);
-   return kneiske.value(energy, redshift);
+std::string dataFile(const std::string & basename) {
+   std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
+   return facilities::commonUtilities::joinPath(datadir, basename);
 }
 
-
-float calcKneiske_HighUV(float energy, float redshift) {
-   static std::string datadir(facilities::commonUtilities::getDataPath("eblAtten"));
-   static std::string od_file =
-      facilities::commonUtilities::joinPath(datadir, "opdep_KNEISKEetal2004_highUV.dat");
-   static AsciiTableModel kneiske_uv(od_file);
-   return kneiske_uv.value(energy, redshift);
+} // anonymous namespace
+
+/// Each model is built on the first call for it; the initialization of
+/// the local statics is thread-safe, and EblAtten makes that call from
+/// its constructor.
+const TauModel & tauModel(EblModel model) {
+   switch (model) {
+   case Kneiske: {
+      static AsciiTableModel kneiske
+         (dataFile("opdep_KNEISKEetal2004_bestfit.dat"));
+      return kneiske;
+   }
+   case Primack05:
+      return Primack05::instance();
+   case Kneiske_HighUV: {
+      static AsciiTableModel kneiske_uv
+         (dataFile("opdep_KNEISKEetal2004_highUV.dat"));
+      return kneiske_uv;
+   }
+   case Stecker05: {
+      static FunctionModel stecker05(calcStecker05);
+      return stecker05;
+   }
+   case Franceschini: {
+      static AsciiTableModel franceschini
+         (dataFile("opdep_Franceschini_2008.dat"));
+      return franceschini;
+   }
+   case Finke: {
+      static AsciiTableModel finke(dataFile("opdep_Finke_2009.dat"));
+      return finke;
+   }
+   case Stecker05_FE: {
+      static FunctionModel stecker05_fe(calcStecker05_FE);
+      return stecker05_fe;
+   }
+   case SalamonStecker: {
+      static AsciiTableModel salamon_stecker
+         (dataFile("opdep_SalamonStecker98.dat"));
+      return salamon_stecker;
+   }
+   case Generic: {
+      static FunctionModel generic(calcGeneric);
+      return generic;
+   }
+   case Gilmore:    // Deprecated, same as Gilmore09
+   case Gilmore09: {
+      static AsciiTableModel gilmore09
+         (dataFile("opdep_GILMOREetal_2009.dat"));
+      return gilmore09;
+   }
+   case Gilmore12_fixed: {
+      /// The Gilmore et al 2012 tables use MeV.
+      static AsciiTableModel gilmore_fixed
+         (dataFile("opdep_fixed_Gilmore2012.dat"), 1e3);
+      return gilmore_fixed;
+   }
+   case Gilmore12_fiducial: {
+      static AsciiTableModel gilmore_fiducial
+         (dataFile("opdep_fiducial_Gilmore2012.dat"), 1e3);
+      return gilmore_fiducial;
+   }
+   case Inoue13: {
+      static AsciiTableModel inoue13(dataFile("opdep_INOUEetal_2013.dat"));
+      return inoue13;
+   }
+   case Dominguez11: {
+      static AsciiTableModel dominguez11
+         (dataFile("opdep_DOMINGUEZetal_2011.dat"));
+      return dominguez11;
+   }
+   case Scully14_highOp: {
+      static AsciiTableModel scully14_highOp
+         (dataFile("opdep_SCULLYetal2014_highOp.dat"));
+      return scully14_highOp;
+   }
+   case Scully14_lowOp: {
+      static AsciiTableModel scully14_lowOp
+         (dataFile("opdep_SCULLYetal2014_lowOp.dat"));
+      return scully14_lowOp;
+   }
+   case KneiskeDole10: {
+      static AsciiTableModel kneiskedole10
+         (dataFile("opdep_KNEISKEandDOLE_2010_noCMB.dat"));
+      return kneiskedole10;
+   }
+   case KneiskeDole10_CMB: {
+      static AsciiTableModel kneiskedole10_cmb
+         (dataFile("opdep_KNEISKEandDOLE_2010.dat"));
+      return kneiskedole10_cmb;
+   }
+   case HelgasonKashlinsky12: {
+      static AsciiTableModel HelgasonKashlinsky12
+         (dataFile("opdep_HELGASONandKASHLINSKY_2012.dat"));
+      return HelgasonKashlinsky12;
+   }
+   }
+   throw std::runtime_error("IRB::tauModel: invalid model ID");
 }
 
-
-float calcPrimack05(float energy, float redshift) {
-   return Primack05::instance().value(energy, redshift);
+void TauModel::values(const float * energies, size_t n, float redshift,
+                      float * tau, double energyScale) const {
+   for (size_t i(0); i < n; i++) {
+      tau[i] = value(float(energies[i]*energyScale), redshift);
+   }
 }
 
-
 float calcGeneric (float energy, float redshift){
 
 //Parametric representation of tau(E,z) from Justin Finke
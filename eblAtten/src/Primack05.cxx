@@ -28,8 +28,6 @@ namespace {
 
 namespace IRB {
 
-Primack05 * Primack05::s_instance(0);
-
 Primack05::Primack05() {
    float zvalue[17] = {0., 0.1, 0.25, 0.5, 1., 1.5, 2., 2.5, 3., 3.5, 
                        4., 4.5, 5., 5.5, 6., 6.5, 7.};
@@ -49,10 +47,8 @@ Primack05::Primack05() {
 }
 
 Primack05 & Primack05::instance() {
-   if (s_instance == 0) {
-      s_instance = new Primack05();
-   }
-   return *s_instance;
+   static Primack05 s_instance;
+   return s_instance;
 }
 
 float Primack05::value(float energy, float redshift) const {
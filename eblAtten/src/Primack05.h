@@ -10,6 +10,8 @@
 
 #include <vector>
 
+#include "TauModel.h"
+
 namespace IRB {
 
 /**
@@ -17,17 +19,23 @@ namespace IRB {
  *
  */
 
-class Primack05 {
+class Primack05 : public TauModel {
 
 public:
 
    static Primack05 & instance();
    
-   float value(float energy, float redshift) const;
+   virtual float value(float energy, float redshift) const;
 
-protected:
+   virtual float maxEnergy() const {
+      return m_evalue.back();
+   }
 
-   static Primack05 * s_instance;
+   virtual float maxRedshift() const {
+      return m_zvalue.back();
+   }
+
+protected:
 
    Primack05();
 
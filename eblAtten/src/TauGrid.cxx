@@ -0,0 +1,259 @@
+/**
+ * @file TauGrid.cxx
+ * @brief Optical depths of an EBL model precomputed on a uniform grid
+ * in log(energy) and redshift.
+ *
+ * $Header$
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include "TauGrid.h"
+
+namespace {
+/// Grid spacings in log(energy) and redshift, and the lower energy
+/// bound (GeV).  All of the models give negligible optical depths
+/// below 0.1 GeV.
+   const float s_dlogE(std::log(10.)/64.);
+   const float s_dz(0.01);
+   const float s_emin(0.1);
+
+   const char s_magic[8] = {'E', 'B', 'L', 'G', 'R', 'I', 'D', '2'};
+}
+
+namespace IRB {
+
+const float TauGrid::s_tolerance(1e-3);
+
+TauGrid::TauGrid(const TauModel & model, int modelId,
+                 const std::string & cacheFile)
+   : m_model(model), m_modelId(modelId), m_tableTime(0), m_tableSize(0),
+     m_maxError(0) {
+   struct stat tableStat;
+   if (model.tableFile() != ""
+       && stat(model.tableFile().c_str(), &tableStat) == 0) {
+      m_tableTime = tableStat.st_mtime;
+      m_tableSize = tableStat.st_size;
+   }
+// Keep the grid nodes slightly inside of the model range so that
+// rounding does not push the last node outside of it.
+   double margin(1e-4);
+   m_logEmin = std::log(s_emin);
+   m_dlogE = s_dlogE;
+   double logEmax(std::log(model.maxEnergy()) - margin);
+   m_ne = logEmax > m_logEmin ? 
+      static_cast<size_t>((logEmax - m_logEmin)/m_dlogE) + 1 : 0;
+   m_logEmax = m_logEmin + (m_ne - 1)*m_dlogE;
+   m_dz = s_dz;
+   double zmax(model.maxRedshift() - margin);
+   m_nz = zmax > 0 ? static_cast<size_t>(zmax/m_dz) + 1 : 0;
+   m_zmax = (m_nz - 1)*m_dz;
+   if (m_ne < 2 || m_nz < 2) {
+      throw std::runtime_error("TauGrid: model range is too small "
+                               "to be tabulated");
+   }
+   if (cacheFile != "" && readCache(cacheFile)) {
+      return;
+   }
+   fillGrid();
+   checkGrid();
+   if (cacheFile != "") {
+      writeCache(cacheFile);
+   }
+}
+
+float TauGrid::value(float energy, float redshift) const {
+   float logEnergy(std::log(energy));
+   if (!inGrid(logEnergy, redshift)) {
+      return m_model.value(energy, redshift);
+   }
+   float z(redshift/m_dz);
+   size_t z_index(std::min(static_cast<size_t>(z), m_nz - 2));
+   return interpolate(logEnergy, redshift, z_index, z - z_index, energy);
+}
+
+void TauGrid::values(const float * energies, size_t n, float redshift,
+                     float * tau, double energyScale) const {
+   if (!(redshift >= 0 && redshift < m_zmax)) {
+      m_model.values(energies, n, redshift, tau, energyScale);
+      return;
+   }
+   float z(redshift/m_dz);
+   size_t z_index(std::min(static_cast<size_t>(z), m_nz - 2));
+   float zfrac(z - z_index);
+   for (size_t i(0); i < n; i++) {
+      float energy(float(energies[i]*energyScale));
+      float logEnergy(std::log(energy));
+      if (logEnergy >= m_logEmin && logEnergy < m_logEmax) {
+         tau[i] = interpolate(logEnergy, redshift, z_index, zfrac, energy);
+      } else {
+         tau[i] = m_model.value(energy, redshift);
+      }
+   }
+}
+
+float TauGrid::interpolate(float logEnergy, float redshift, size_t z_index,
+                           float zfrac, float energy) const {
+   float x((logEnergy - m_logEmin)/m_dlogE);
+   size_t e_index(std::min(static_cast<size_t>(x), m_ne - 2));
+   if (m_exact[z_index*(m_ne - 1) + e_index]) {
+      return m_model.value(energy, redshift);
+   }
+   return bilinear(e_index, x - e_index, z_index, zfrac);
+}
+
+float TauGrid::bilinear(size_t e_index, float efrac,
+                        size_t z_index, float zfrac) const {
+   const float * tau1 = &m_tau[z_index*m_ne + e_index];
+   const float * tau2 = tau1 + m_ne;
+   return ( (1 - zfrac)*((1 - efrac)*tau1[0] + efrac*tau1[1])
+            + zfrac*((1 - efrac)*tau2[0] + efrac*tau2[1]) );
+}
+
+void TauGrid::fillGrid() {
+   std::vector<float> energies(m_ne);
+   for (size_t i(0); i < m_ne; i++) {
+      energies[i] = std::exp(m_logEmin + i*m_dlogE);
+   }
+   m_tau.resize(m_ne*m_nz);
+   for (size_t j(0); j < m_nz; j++) {
+      m_model.values(&energies[0], m_ne, j*m_dz, &m_tau[j*m_ne]);
+   }
+   m_exact.assign((m_ne - 1)*(m_nz - 1), 0);
+}
+
+void TauGrid::checkGrid() {
+// Compare with the model at the centre and at the midpoints of the
+// edges of each cell.
+   std::vector<float> nodes(m_ne);
+   std::vector<float> midpoints(m_ne - 1);
+   for (size_t i(0); i < m_ne; i++) {
+      nodes[i] = std::exp(m_logEmin + i*m_dlogE);
+      if (i < m_ne - 1) {
+         midpoints[i] = std::exp(m_logEmin + (i + 0.5)*m_dlogE);
+      }
+   }
+   std::vector<float> lower(m_ne - 1), upper(m_ne - 1);
+   std::vector<float> sides(m_ne), centres(m_ne - 1);
+   m_model.values(&midpoints[0], m_ne - 1, 0, &lower[0]);
+   m_maxError = 0;
+   for (size_t j(0); j < m_nz - 1; j++) {
+      float redshift((j + 0.5)*m_dz);
+      m_model.values(&midpoints[0], m_ne - 1, (j + 1)*m_dz, &upper[0]);
+      m_model.values(&nodes[0], m_ne, redshift, &sides[0]);
+      m_model.values(&midpoints[0], m_ne - 1, redshift, &centres[0]);
+      for (size_t i(0); i < m_ne - 1; i++) {
+         float error(std::max(std::max(attenuationError(i, 0.5, j, 0, lower[i]),
+                                       attenuationError(i, 0.5, j, 1, upper[i])),
+                              std::max(attenuationError(i, 0, j, 0.5, sides[i]),
+                                       attenuationError(i, 1, j, 0.5,
+                                                        sides[i + 1]))));
+         error = std::max(error, attenuationError(i, 0.5, j, 0.5, centres[i]));
+         if (error > s_tolerance) {
+            m_exact[j*(m_ne - 1) + i] = 1;
+         } else {
+            m_maxError = std::max(m_maxError, error);
+         }
+      }
+      lower.swap(upper);
+   }
+}
+
+float TauGrid::attenuationError(size_t e_index, float efrac,
+                                size_t z_index, float zfrac,
+                                float tau) const {
+   return std::fabs(std::exp(-bilinear(e_index, efrac, z_index, zfrac))
+                    - std::exp(-tau));
+}
+
+bool TauGrid::readCache(const std::string & cacheFile) {
+   std::ifstream input(cacheFile.c_str(), std::ios::binary);
+   if (!input) {
+      return false;
+   }
+   char magic[8];
+   int modelId;
+   long long tableTime, tableSize;
+   size_t ne, nz;
+   float logEmin, logEmax, zmax, tolerance, maxError;
+   input.read(magic, sizeof(magic));
+   input.read(reinterpret_cast<char *>(&modelId), sizeof(modelId));
+   input.read(reinterpret_cast<char *>(&tableTime), sizeof(tableTime));
+   input.read(reinterpret_cast<char *>(&tableSize), sizeof(tableSize));
+   input.read(reinterpret_cast<char *>(&ne), sizeof(ne));
+   input.read(reinterpret_cast<char *>(&nz), sizeof(nz));
+   input.read(reinterpret_cast<char *>(&logEmin), sizeof(logEmin));
+   input.read(reinterpret_cast<char *>(&logEmax), sizeof(logEmax));
+   input.read(reinterpret_cast<char *>(&zmax), sizeof(zmax));
+   input.read(reinterpret_cast<char *>(&tolerance), sizeof(tolerance));
+   input.read(reinterpret_cast<char *>(&maxError), sizeof(maxError));
+   if (!input || std::memcmp(magic, s_magic, sizeof(magic)) != 0
+       || modelId != m_modelId || tableTime != m_tableTime
+       || tableSize != m_tableSize || ne != m_ne || nz != m_nz
+       || logEmin != m_logEmin || logEmax != m_logEmax || zmax != m_zmax
+       || tolerance != s_tolerance) {
+      return false;
+   }
+   m_tau.resize(m_ne*m_nz);
+   m_exact.resize((m_ne - 1)*(m_nz - 1));
+   input.read(reinterpret_cast<char *>(&m_tau[0]),
+              m_tau.size()*sizeof(float));
+   input.read(&m_exact[0], m_exact.size());
+   if (!input) {
+      return false;
+   }
+   m_maxError = maxError;
+   return true;
+}
+
+void TauGrid::writeCache(const std::string & cacheFile) const {
+// Write to a temporary file and rename it, so that other jobs see either
+// the old cache or the complete new one.
+   std::ostringstream tmpFile;
+   tmpFile << cacheFile << ".tmp";
+#ifndef WIN32
+   tmpFile << getpid();
+#endif
+   std::ofstream output(tmpFile.str().c_str(), std::ios::binary);
+   if (!output) {
+// The cache is an optimization, so failing to write it is not an error.
+      return;
+   }
+   output.write(s_magic, sizeof(s_magic));
+   output.write(reinterpret_cast<const char *>(&m_modelId), sizeof(m_modelId));
+   output.write(reinterpret_cast<const char *>(&m_tableTime),
+                sizeof(m_tableTime));
+   output.write(reinterpret_cast<const char *>(&m_tableSize),
+                sizeof(m_tableSize));
+   output.write(reinterpret_cast<const char *>(&m_ne), sizeof(m_ne));
+   output.write(reinterpret_cast<const char *>(&m_nz), sizeof(m_nz));
+   output.write(reinterpret_cast<const char *>(&m_logEmin), sizeof(m_logEmin));
+   output.write(reinterpret_cast<const char *>(&m_logEmax), sizeof(m_logEmax));
+   output.write(reinterpret_cast<const char *>(&m_zmax), sizeof(m_zmax));
+   output.write(reinterpret_cast<const char *>(&s_tolerance),
+                sizeof(s_tolerance));
+   output.write(reinterpret_cast<const char *>(&m_maxError),
+                sizeof(m_maxError));
+   output.write(reinterpret_cast<const char *>(&m_tau[0]),
+                m_tau.size()*sizeof(float));
+   output.write(&m_exact[0], m_exact.size());
+   output.close();
+   if (!output || std::rename(tmpFile.str().c_str(), cacheFile.c_str()) != 0) {
+      std::remove(tmpFile.str().c_str());
+   }
+}
+
+} // namespace IRB
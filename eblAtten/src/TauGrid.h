@@ -0,0 +1,129 @@
+/**
+ * @file TauGrid.h
+ * @brief Optical depths of an EBL model precomputed on a uniform grid
+ * in log(energy) and redshift.
+ *
+ * $Header$
+ */
+
+#ifndef IRB_TauGrid_h
+#define IRB_TauGrid_h
+
+#include <string>
+#include <vector>
+
+#include "TauModel.h"
+
+namespace IRB {
+
+/**
+ * @class TauGrid
+ * @brief Bilinear interpolation, in log(energy) and redshift, of an
+ * EBL model sampled once on a uniform grid.  The grid covers energies
+ * from 0.1 GeV to the model's maxEnergy() and redshifts from 0 to its
+ * maxRedshift(); outside of that range the model itself is used.
+ *
+ * After the grid is filled, the interpolated attenuation exp(-tau) is
+ * compared with the model at the centre and at the midpoints of the
+ * edges of every grid cell.  Cells where the difference exceeds
+ * s_tolerance are flagged and evaluated with the model.  maxError()
+ * gives the largest difference found over the cells that are
+ * interpolated.  The models are linear interpolations in redshift of
+ * tables that start at finite redshifts and energies, so they have
+ * kinks and steps that can fall between the test points; sampling the
+ * models at random points for 1 < E < 250 GeV and 0 < z < 3 gives
+ * differences in exp(-tau) of at most 2e-3.
+ */
+
+class TauGrid : public TauModel {
+
+public:
+
+   /// @param model The model to be tabulated.  It must outlive this object.
+   /// @param modelId Identifier of the model, stored in the cache file.
+   /// @param cacheFile Binary file from which the grid is read, if it
+   ///        exists and matches, or to which it is written otherwise.
+   ///        The cache matches if it was made for the same model and
+   ///        grid, and from a table file (see TauModel::tableFile) with
+   ///        the same modification time and size.  It is written to a
+   ///        temporary file that is then renamed, so that concurrent
+   ///        jobs never read a partial cache.  No file is used if this
+   ///        is empty.
+   TauGrid(const TauModel & model, int modelId,
+           const std::string & cacheFile="");
+
+   virtual float value(float energy, float redshift) const;
+
+   virtual void values(const float * energies, size_t n, float redshift,
+                       float * tau, double energyScale=1) const;
+
+   virtual float maxEnergy() const {
+      return m_model.maxEnergy();
+   }
+
+   virtual float maxRedshift() const {
+      return m_model.maxRedshift();
+   }
+
+   /// @return Largest difference in exp(-tau) with respect to the model
+   /// found at the test points of the interpolated cells.
+   float maxError() const {
+      return m_maxError;
+   }
+
+   /// Tolerance on exp(-tau) used to flag the cells evaluated exactly.
+   static const float s_tolerance;
+
+private:
+
+   const TauModel & m_model;
+   int m_modelId;
+
+   /// Modification time and size of the model's table file, 0 if it
+   /// has none.
+   long long m_tableTime;
+   long long m_tableSize;
+
+   size_t m_ne;
+   size_t m_nz;
+   float m_logEmin;
+   float m_logEmax;
+   float m_dlogE;
+   float m_zmax;
+   float m_dz;
+
+   /// Optical depths, m_ne values for each of the m_nz redshifts.
+   std::vector<float> m_tau;
+
+   /// Flags for the (m_ne - 1)*(m_nz - 1) cells evaluated with the model.
+   std::vector<char> m_exact;
+
+   float m_maxError;
+
+   bool inGrid(float logEnergy, float redshift) const {
+      return (logEnergy >= m_logEmin && logEnergy < m_logEmax
+              && redshift >= 0 && redshift < m_zmax);
+   }
+
+   float interpolate(float logEnergy, float redshift, size_t z_index,
+                     float zfrac, float energy) const;
+
+   float bilinear(size_t e_index, float efrac,
+                  size_t z_index, float zfrac) const;
+
+   float attenuationError(size_t e_index, float efrac,
+                          size_t z_index, float zfrac, float tau) const;
+
+   void fillGrid();
+
+   void checkGrid();
+
+   bool readCache(const std::string & cacheFile);
+
+   void writeCache(const std::string & cacheFile) const;
+
+};
+
+} // namespace IRB
+
+#endif // IRB_TauGrid_h
@@ -0,0 +1,62 @@
+/**
+ * @file TauModel.h
+ * @brief Abstract interface to an EBL optical depth model as a function
+ * of energy and redshift.
+ *
+ * $Header$
+ */
+
+#ifndef IRB_TauModel_h
+#define IRB_TauModel_h
+
+#include <cstddef>
+#include <string>
+
+namespace IRB {
+
+/**
+ * @class TauModel
+ * @brief Base class for the models behind EblAtten.  Energies are in GeV.
+ * Models are fully initialized by their constructors and are not
+ * modified afterwards, so a model may be evaluated from several threads.
+ */
+
+class TauModel {
+
+public:
+
+   virtual ~TauModel() {}
+
+   /// @return Optical depth at one energy (GeV) and redshift.
+   virtual float value(float energy, float redshift) const = 0;
+
+   /// Optical depths for n energies at a single redshift.  The energies
+   /// are converted to GeV by multiplying them by energyScale.  The
+   /// default implementation calls value() for each energy; table models
+   /// override it to do the redshift interpolation only once per call.
+   virtual void values(const float * energies, size_t n, float redshift,
+                       float * tau, double energyScale=1) const;
+
+   /// @return Upper limit (GeV) of the energies at which the model can
+   /// be evaluated.
+   virtual float maxEnergy() const {
+      return 1e5;
+   }
+
+   /// @return Upper limit of the redshifts at which the model can be
+   /// evaluated.
+   virtual float maxRedshift() const {
+      return 5;
+   }
+
+   /// @return File from which the model is read, or an empty string
+   /// if it is not read from a file.
+   virtual std::string tableFile() const {
+      return "";
+   }
+
+};
+
+} // namespace IRB
+
+#endif // IRB_TauModel_h
@@ -0,0 +1,33 @@
+/**
+ * @file makeBinaryTables.cxx
+ * @brief Convert ascii EBL optical depth tables to the binary format
+ * that AsciiTableModel memory-maps in place of parsing them.
+ *
+ * $Header$
+ */
+
+#include <iostream>
+#include <stdexcept>
+
+#include "AsciiTableModel.h"
+
+int main(int iargc, char * argv[]) {
+   if (iargc < 2) {
+      std::cout << "usage: " << argv[0] << " <table.dat> [<table.dat> ...]\n"
+                << "Writes <table>.bin next to each ascii table."
+                << std::endl;
+      return 1;
+   }
+   try {
+      for (int i = 1; i < iargc; i++) {
+         std::string infile(argv[i]);
+         std::string outfile(IRB::AsciiTableModel::binaryFile(infile));
+         IRB::AsciiTableModel::writeBinaryTable(infile, outfile);
+         std::cout << infile << " -> " << outfile << std::endl;
+      }
+   } catch (std::exception & eObj) {
+      std::cout << eObj.what() << std::endl;
+      return 1;
+   }
+   return 0;
+}
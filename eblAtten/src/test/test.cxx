@@ -11,13 +11,18 @@
 #endif
 
 #include <cmath>
+#include <cstdio>
 
+#include <fstream>
 #include <iostream>
+#include <vector>
 
 #include "facilities/commonUtilities.h"
 
 #include "eblAtten/EblAtten.h"
 
+#include "AsciiTableModel.h"
+
 int main() {
 #ifdef TRAP_FPE
    feenableexcept(FE_INVALID | FE_DIVBYZERO | FE_OVERFLOW);
@@ -76,4 +81,96 @@ int main() {
                    << std::endl;
       }
    }
+
+// Check the array interface against the scalar one.
+   IRB::EblAtten * models[20] = {&tau0, &tau1, &tau2, &tau3, &tau4, &tau5,
+                                 &tau6, &tau7, &tau8, &tau9, &tau10, &tau11,
+                                 &tau12, &tau13, &tau14, &tau15, &tau16,
+                                 &tau17, &tau18, &tau19};
+   std::vector<float> energies;
+   for (int i = 0; i < npts; i++) {
+      energies.push_back(emin*std::exp(i*estep));
+   }
+   std::vector<float> taus;
+   for (int k = 0; k < 20; k++) {
+      double maxdiff(0);
+      for (int j = 0; j < 7; j++) {
+         (*models[k])(energies, z[j], taus);
+         for (int i = 0; i < npts; i++) {
+            float scalar((*models[k])(energies[i], z[j]));
+// Optical depths below 1e-6 are compared in absolute terms: their
+// rounding errors are fractionally larger, but do not change exp(-tau).
+            double diff(std::fabs(taus[i] - scalar)/(std::fabs(scalar) + 1e-6));
+            if (diff > maxdiff) {
+               maxdiff = diff;
+            }
+         }
+      }
+      std::cout << "array vs scalar, model " << k 
+                << ": max fractional difference " << maxdiff << std::endl;
+      if (maxdiff > 1e-5) {
+         std::cout << "array and scalar optical depths differ by more "
+                   << "than float precision" << std::endl;
+         return 1;
+      }
+   }
+
+// Compare the precomputed grids with the models.
+   for (int k = 0; k < 20; k++) {
+      IRB::EblAtten grid(models[k]->model());
+      grid.useGrid();
+      double maxdiff(0);
+      for (int j = 0; j < 7; j++) {
+         for (int i = 0; i < npts; i++) {
+            double diff(std::fabs(std::exp(-grid(energies[i], z[j]))
+                                  - std::exp(-(*models[k])(energies[i], z[j]))));
+            if (diff > maxdiff) {
+               maxdiff = diff;
+            }
+         }
+      }
+      std::cout << "grid vs model, model " << k
+                << ": max difference in exp(-tau) " << maxdiff
+                << ", at test points " << grid.maxGridError() << std::endl;
+      if (maxdiff > 2e-3) {
+         std::cout << "grid and model attenuations differ by more than "
+                   << "2e-3" << std::endl;
+         return 1;
+      }
+   }
+
+// Convert a table to binary twice, the second time while the first
+// binary table is mapped, and compare both with the ascii table.
+   std::string table(facilities::commonUtilities::joinPath(
+      facilities::commonUtilities::getDataPath("eblAtten"),
+      "opdep_Finke_2009.dat"));
+   std::string asciiCopy("eblAtten_test_table.dat");
+   std::string binaryCopy(IRB::AsciiTableModel::binaryFile(asciiCopy));
+   {
+      std::ifstream input(table.c_str(), std::ios::binary);
+      std::ofstream output(asciiCopy.c_str(), std::ios::binary);
+      output << input.rdbuf();
+   }
+   std::remove(binaryCopy.c_str());
+   IRB::AsciiTableModel ascii(asciiCopy);
+   IRB::AsciiTableModel::writeBinaryTable(asciiCopy, binaryCopy);
+   IRB::AsciiTableModel binary1(asciiCopy);
+   IRB::AsciiTableModel::writeBinaryTable(asciiCopy, binaryCopy);
+   IRB::AsciiTableModel binary2(asciiCopy);
+   for (int j = 0; j < 7; j++) {
+      for (int i = 0; i < npts; i++) {
+         float energy(energies[i]/1e3);
+         float value(ascii.value(energy, z[j]));
+         if (binary1.value(energy, z[j]) != value
+             || binary2.value(energy, z[j]) != value) {
+            std::cout << "binary and ascii tables differ at E = " << energy
+                      << " GeV, z = " << z[j] << std::endl;
+            return 1;
+         }
+      }
+   }
+   std::cout << "binary tables converted twice match the ascii table"
+             << std::endl;
+   std::remove(asciiCopy.c_str());
+   std::remove(binaryCopy.c_str());
 }
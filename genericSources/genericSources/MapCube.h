@@ -24,6 +24,13 @@
  * should comprise data cube with two spatial dimensions and an energy
  * dimension.
  *
+ * Given emin and emax (MeV) in the keyword form of the parameters, only
+ * photons in that band are produced: pixels are drawn from the counts
+ * within the band, energies are drawn within the band, and the flux is
+ * scaled by the fraction of the counts of the map that lie in the band.
+ * The result follows the same distribution as the photons of the full
+ * map that fall in the band, without generating the others.
+ *
  * @author J. Chiang
  *
  * $Header$
@@ -69,28 +76,48 @@ private:
    /// from the flux/Spectrum base class).
    mutable std::pair<double, double> m_currentDir;
 
-//   typedef std::pair<double, double> SpectralPoint_t;
-   typedef std::pair<float, float> SpectralPoint_t;
+   /// Cumulative counts spectra and power-law indices of all of the
+   /// pixels, stored contiguously in single precision.  For each pixel
+   /// there are m_energies.size() cumulative counts at the energy nodes
+   /// followed by the m_energies.size() - 1 indices of the intervals;
+   /// see spectrum(indx).
+   std::vector<float> m_spectra;
+   std::vector<double> m_energies;
 
-   typedef std::vector<SpectralPoint_t> Spectrum_t;
+   /// The spectra in use, either m_spectra or mapped from m_index.
+   const float * m_spectraData;
 
-   std::vector<Spectrum_t> m_spectra;
-   std::vector<double> m_energies;
+   size_t spectrumSize() const {
+      return 2*m_energies.size() - 1;
+   }
 
-   double mapValue(unsigned int i, unsigned int j, unsigned int k);
+   const float * spectrum(unsigned int indx) const {
+      return m_spectraData + indx*spectrumSize();
+   }
+
+   /// @return true if the MapSource sections of index are valid, and
+   ///         the spectra section holds a spectrum for each pixel.
+   virtual bool validIndex(const genericSources::MapIndex & index,
+                           size_t & npix) const;
 
    void readEnergyVector(const std::string & fitsFile);
    
    void makeCumulativeSpectra();
 
-   double powerLawIntegral(double x1, double x2, double y1, double y2,
-                           double & gamma) const;
-                           
-   double drawEnergy(const Spectrum_t & spectrum)
-      const;
+   /// Limit the energy band to the energies of the cube; m_emax is
+   /// zero if there is no band.  The band is within intervals
+   /// m_firstInterval to m_lastInterval of the energy vector.
+   void setEnergyBand();
+   size_t m_firstInterval;
+   size_t m_lastInterval;
+
+   /// @return Index of the energy interval containing energy.
+   size_t energyInterval(double energy) const;
+
+   /// @return Cumulative counts of a pixel spectrum up to energy.
+   double cumulativeCounts(const float * spectrum, double energy) const;
 
-   static bool cmpPair(const SpectralPoint_t & x, 
-                       const SpectralPoint_t & y);
+   double drawEnergy(const float * spectrum) const;
 
    void checkForNonPositivePixels(const std::string &) const;
 
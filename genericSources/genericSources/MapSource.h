@@ -10,12 +10,20 @@
 #ifndef mySpectrum_MapSource_h
 #define mySpectrum_MapSource_h
 
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "flux/Spectrum.h"
 
+namespace celestialSources {
+   class ConstParMap;
+}
+
 namespace genericSources {
    class FitsImage;
+   class MapIndex;
+   class SkyRegion;
 }
 
 /**
@@ -24,6 +32,33 @@ namespace genericSources {
  * @brief A source class for the flux package that uses FITS images as
  * templates for the photon distribution on the sky.
  *
+ * The FITS file holds either a plate-carree image or a HEALPix map in
+ * a binary table (see genericSources::HealpixImage).
+ *
+ * By default, pixels are drawn by a binary search of the cumulative
+ * distribution over the map.  Given pixelSampler=alias, they are drawn
+ * in constant time from a Walker alias table instead; this follows the
+ * same distribution but uses a different sequence of random numbers.
+ * Given pixelSampler=tiles, a tile of consecutive pixels is drawn from
+ * a coarse cumulative distribution, and a pixel from the float weights
+ * of the pixels in that tile, by summing them.  The table is 4 bytes
+ * per pixel, against 8 for the cumulative distribution or the alias
+ * table, but each draw scans up to 2*256 weights; the image is still
+ * read in full to build it.
+ *
+ * A region of interest restricts the map to the pixels with centres in
+ * a cone and/or a polygon, given in the keyword parameters as
+ * roiCone=lon:lat:radius and roiPolygon=lon1:lat1:lon2:lat2:..., in
+ * degrees, in the frame roiFrame=equatorial (the default) or galactic.
+ * Only those pixels are kept and sampled, and the flux is scaled by
+ * their share of the map integral, as for a sub-map.
+ *
+ * If the GENERICSOURCES_MAP_INDEX environment variable names a
+ * directory, the sampling tables are saved there (see
+ * genericSources::MapIndex), and later constructions from the same
+ * FITS file with the same sub-map and sampler use the saved tables
+ * without reading the file.
+ *
  * @author J. Chiang
  *
  * $Header$
@@ -37,7 +72,7 @@ public:
    /// "SpectrumClass" sources.
    MapSource(const std::string &params);
 
-   virtual ~MapSource() {}
+   virtual ~MapSource();
 
    /// @return Particle energy in MeV.
    /// @param xi Uniform random deviate on the unit interval.
@@ -73,7 +108,11 @@ public:
 protected:
 
    /// default constructor for subclasses;
-   MapSource() : m_gamma(0), m_emin(0), m_emax(0) {}
+   MapSource() : m_gamma(0), m_emin(0), m_emax(0), m_nside(0),
+                 m_nested(false), m_pixelSampler(SEARCH), m_index(0),
+                 m_integralValues(0), m_aliasEntries(0), m_tileValues(0),
+                 m_weightValues(0), m_npix(0), m_ntiles(0), m_fluxScale(1),
+                 m_region(0) {}
 
    double m_flux;
    double m_gamma;
@@ -83,8 +122,18 @@ protected:
    std::vector<std::string> m_axisTypes;
    std::vector<double> m_lon;
    std::vector<double> m_lat;
-   std::vector<double> m_lonArray;
-   std::vector<double> m_latArray;
+
+   /// HEALPix resolution and ordering, for a HEALPix map, in which case
+   /// m_lon and m_lat are empty.  Zero for a plate-carree image.
+   long m_nside;
+   bool m_nested;
+
+   /// Indices in the full image (for HEALPix maps, the pixel numbers)
+   /// of the pixels that are sampled, if not all of them are.
+   std::vector<long long> m_pixels;
+
+   /// Pixel solid angles and image data, needed only while the
+   /// sampling distributions are built; see releasePixelArrays.
    std::vector<double> m_solidAngles;
    std::vector<double> m_image;
 
@@ -92,10 +141,111 @@ protected:
 
    double m_mapIntegral;
 
+   /// Entry of the Walker alias table used to draw a pixel: column i
+   /// yields pixel i with probability prob, and pixel alias otherwise.
+   struct AliasEntry {
+      float prob;
+      unsigned int alias;
+   };
+   std::vector<AliasEntry> m_aliasTable;
+
+   /// Pixel weights, and the cumulative distribution over tiles of
+   /// s_tileSize consecutive pixels, used by the tile sampler.
+   std::vector<float> m_pixelWeights;
+   std::vector<double> m_tileDist;
+
+   static const size_t s_tileSize;
+
+   /// How pixels are drawn: by a search of m_integralDist, from
+   /// m_aliasTable, or by tile.
+   enum PixelSampler {SEARCH, ALIAS, TILES};
+   PixelSampler m_pixelSampler;
+
+   /// Saved sampling tables, if they were found.
+   genericSources::MapIndex * m_index;
+
+   /// The sampling tables in use, which are either built in the vectors
+   /// above or mapped from m_index; and the numbers of pixels and tiles.
+   const double * m_integralValues;
+   const AliasEntry * m_aliasEntries;
+   const double * m_tileValues;
+   const float * m_weightValues;
+   size_t m_npix;
+   size_t m_ntiles;
+
+   /// Factor by which the flux has been rescaled for a sub-map or a
+   /// region of interest.
+   double m_fluxScale;
+
+   /// Region of interest, if one was given.
+   genericSources::SkyRegion * m_region;
+
+   /// Set the region of interest from the roi parameters, if any.
+   void setRegion(celestialSources::ConstParMap & parmap);
+
+   /// Keep only the pixels with centres in the region of interest.
+   void applyRegion();
+
+   /// @return Index of the first pixel that is sampled.  As in
+   ///         FitsImage::mapIntegral, the first pixel of a whole
+   ///         plate-carree image is left out, but HEALPix maps and
+   ///         regions of interest keep all of their pixels.
+   size_t firstPixel() const {
+      return m_nside == 0 && m_pixels.empty() ? 1 : 0;
+   }
+
+   /// Direction of the centre of a pixel, in the map coordinates.
+   void pixelCentre(unsigned int indx, double & lon, double & lat) const;
+
+   /// A section of the saved sampling tables: its data and size in bytes.
+   typedef std::pair<const void *, size_t> IndexSection;
+
+   /// Number of index sections holding the MapSource tables, including
+   /// the key.  Sections added by subclasses follow these.
+   static const size_t s_indexSections;
+
+   /// @return Key identifying the sampling tables built by the class
+   ///         named kind from fitsFile, or "" if they cannot be saved.
+   std::string indexKey(const std::string & fitsFile, const std::string & kind,
+                        bool createSubMap) const;
+
+   /// Use the saved sampling tables for key, if they exist and have
+   /// nsections sections.
+   bool loadIndex(const std::string & key, size_t nsections=s_indexSections);
+
+   /// @return true if the sections of index have the sizes implied by
+   ///         the map, so that they can be used without reading past
+   ///         their ends.
+   /// @param npix Number of pixels of the sampling table (output).
+   virtual bool validIndex(const genericSources::MapIndex & index,
+                           size_t & npix) const;
+
+   /// Save the sampling tables for key, followed by the subclass sections.
+   void saveIndex(const std::string & key,
+                  const std::vector<IndexSection> & sections
+                  =std::vector<IndexSection>()) const;
+
+   /// @param sampler One of "search", "alias" or "tiles".
+   void setPixelSampler(const std::string & sampler);
+
+   /// @return Index of a pixel drawn from the map.
+   /// @param xi Uniform random deviate on the unit interval.
+   unsigned int drawPixel(double xi) const;
+
    void samplePixel(unsigned int indx, double &lon, double &lat) const;
    void readFitsFile(std::string fitsFile, bool createSubMap=false);
+   void readHealpixFile(const std::string & fitsFile, bool createSubMap);
    void makeIntegralDistribution(const std::vector<double> & pixelValues);
    void getSubMapAxes(const genericSources::FitsImage & fitsImage);
+   void makeTiles(const std::vector<double> & pixelValues);
+
+   /// @return Index of a pixel drawn from the weights of a tile.
+   /// @param xi Uniform random deviate on the unit interval.
+   unsigned int tilePixel(size_t tile, double xi) const;
+
+   /// Free m_solidAngles and m_image once the sampling distributions
+   /// have been built.
+   void releasePixelArrays();
 
    double m_lonMin;
    double m_lonMax;
@@ -29,6 +29,15 @@ namespace IRB {
  * are read in from a standard flux-style xml file and so may be
  * modeled using a power-law or broken power-law.
  *
+ * The source catalog may be an ascii file with one source per line,
+ *
+ *    name  ra  dec  flux  gamma  gamma2  ebreak  emin  emax  [z]
+ *
+ * a FITS file with a binary table extension named SOURCES that has
+ * columns of those names, or a binary catalog written by
+ * writeBinaryCatalog.  The format is determined from the contents of
+ * the file.
+ *
  * @author J. Chiang
  *
  * $Header$
@@ -76,6 +85,11 @@ public:
 
    virtual std::string name() const;
 
+   /// Convert a catalog in any of the supported formats to the binary
+   /// format, which is the fastest to load.
+   static void writeBinaryCatalog(const std::string & infile,
+                                  const std::string & outfile);
+
 private:
 
    IRB::EblAtten * m_tau;
@@ -84,67 +98,82 @@ private:
    double m_l;
    double m_b;
    double m_currentEnergy;
-   std::string m_name; /// name of current source
-
-   std::vector<double> m_cumulativeFlux;
-
+   size_t m_currentSource; /// index of current source
+
+   /**
+    * @class PointSource
+    * @brief Broken power-law spectral model of one source.
+    *
+    * Energies of attenuated sources are drawn from the unattenuated
+    * spectrum and rejected against exp(-tau).  Once a source has had
+    * s_nodes rejections, about what it takes to start tabulating its
+    * attenuated spectrum, the table is built, and energies are drawn
+    * from its inverse cumulative distribution instead.
+    *
+    * The table is a power-law in each interval between nodes.  Starting
+    * from s_nodes log-spaced nodes, intervals are split until the error
+    * of the cumulative distribution, estimated from the difference
+    * between the tabulated and the actual dN/dE at the middle of each
+    * interval, is below s_tolerance of the total.  If that takes more
+    * than s_maxNodes nodes, no table is built and the source keeps
+    * using rejection sampling.
+    */
    class PointSource {
    public:
-      PointSource(const astro::SkyDir & dir, double flux,
-                  double gamma, double gamma2, double ebreak,
+      PointSource(double gamma, double gamma2, double ebreak,
                   double emin, double emax, double zz);
 
-      PointSource(const std::string & line);
-
       ~PointSource() {}
 
-      /// @return Photon direction as a SkyDir object
-      const astro::SkyDir & dir() const {
-         return m_dir;
-      }
-
       /// @return Draw the photon energy from the spectral model (MeV)
       double energy() const;
 
-      /// @return Photon flux (#/m^2/s)
-      double flux() const {
-         return m_flux;
-      }
-
-      static void setEblAtten(IRB::EblAtten * tau) {
-         s_tau = tau;
+      /// Set the EBL model used to attenuate this source's spectrum.
+      /// The EblAtten object is owned by the SourcePopulation.
+      void setEblAtten(const IRB::EblAtten * tau) {
+         m_tau = tau;
       }
 
       double integral(double emin, double emax);
 
-      std::string name()const{
-          return m_name;
-      }
-
    private:
 
-      astro::SkyDir m_dir;
-      double m_flux;
       double m_gamma;
       double m_gamma2;
       double m_ebreak;
       double m_emin;
       double m_emax;
       double m_z;
+      double m_frac;
 
-      static IRB::EblAtten * s_tau;
+      const IRB::EblAtten * m_tau;
 
-      double m_part1;
-      double m_part2;
-      double m_frac;
-      std::string m_name; /// name of the source
+      /// Number of rejected draws before the table is built.
+      mutable unsigned int m_rejections;
+
+      /// Tabulated attenuated spectrum, empty until built: for each of
+      /// the nodes, the energy, dN/dE, the cumulative integral of dN/dE,
+      /// and the power-law index to the next node.
+      mutable std::vector<double> m_table;
+
+      static const size_t s_nodes;
+      static const size_t s_maxNodes;
+      static const double s_tolerance;
 
       void setPowerLaw();
 
+      double drawUnattenuated() const;
+
+      void makeTable() const;
+
+      double drawFromTable(double xi) const;
+
       double dnde(double energy) const;
 
       double attenuation(double energy) const;
 
+      double attenuatedDnde(double energy, float tau) const;
+
       class DndeIntegrand {
       public:
          DndeIntegrand(const PointSource & pointSource) 
@@ -158,12 +187,68 @@ private:
 
    };
 
+   /// Per-source fields, stored as parallel arrays indexed by source.
+   std::vector<std::string> m_names;
+   std::vector<double> m_ls;       /// Galactic longitudes (degrees)
+   std::vector<double> m_bs;       /// Galactic latitudes (degrees)
    std::vector<PointSource> m_sources;
 
+   /// Entry of the Walker alias table used to select a source with
+   /// probability proportional to its flux: column i yields source i
+   /// with probability prob, and source alias otherwise.
+   struct AliasEntry {
+      double prob;
+      size_t alias;
+   };
+   std::vector<AliasEntry> m_aliasTable;
+
+   /// Numerical fields of one catalog entry, in the order of the
+   /// ascii catalog columns.
+   struct CatalogEntry {
+      double ra;
+      double dec;
+      double flux;
+      double gamma;
+      double gamma2;
+      double ebreak;
+      double emin;
+      double emax;
+      double z;
+   };
+
    void setEblAtten(const std::string & ebl_par);
 
    void readSourceFile(std::string input_file);
 
+   /// Fill the per-source arrays from the catalog entries.  The sources
+   /// are set up on as many threads as there are cores.
+   void setupSources(const std::vector<CatalogEntry> & entries);
+
+   static void readCatalog(const std::string & input_file,
+                           std::vector<std::string> & names,
+                           std::vector<CatalogEntry> & entries);
+
+   static void readTextCatalog(const std::string & input_file,
+                               std::vector<std::string> & names,
+                               std::vector<CatalogEntry> & entries);
+
+   static void readBinaryCatalog(const std::string & input_file,
+                                 std::vector<std::string> & names,
+                                 std::vector<CatalogEntry> & entries);
+
+   static void readFitsCatalog(const std::string & input_file,
+                               std::vector<std::string> & names,
+                               std::vector<CatalogEntry> & entries);
+
+   /// @return Index of the source for a column of the alias table and
+   ///         a uniform deviate.
+   size_t selectSource(size_t column, double xi) const {
+      const AliasEntry & entry(m_aliasTable[column]);
+      return xi < entry.prob ? column : entry.alias;
+   }
+
+   float drawPhoton(size_t indx);
+
 };
 
 #endif // genericSources_SourcePopulation_h
@@ -13,6 +13,8 @@ def generate(env, **kw):
     env.Tool('eblAttenLib')
     env.Tool('addLibrary', library = env['cfitsioLibs'])
     env.Tool('addLibrary', library = env['clhepLibs'])
+    if env['PLATFORM'] != 'win32':
+        env.Tool('addLibrary', library = ['pthread'])
     if env.get('CONTAINERNAME', '') != 'ScienceTools_User':
         env.Tool('addLibrary', library = env['rootGuiLibs'])
 
@@ -0,0 +1,71 @@
+/**
+ * @file AliasTable.h
+ * @brief Build Walker alias tables for drawing items by weight.
+ *
+ * $Header$
+ */
+
+#ifndef genericSources_AliasTable_h
+#define genericSources_AliasTable_h
+
+#include <cstddef>
+#include <vector>
+
+namespace genericSources {
+
+/**
+ * Fill table with the alias table for the weights, by Vose's algorithm:
+ * scale the weights so that they average to one, then repeatedly fill
+ * the remainder of an under-full column with an over-full item.  Column
+ * i of the table yields item i with probability table[i].prob, and item
+ * table[i].alias otherwise.  Entry may use any floating-point type for
+ * prob and any unsigned type wide enough for the item indices for alias.
+ * @return The sum of the weights.
+ */
+template <typename Weight, typename Entry>
+double makeAliasTable(const std::vector<Weight> & weights,
+                      std::vector<Entry> & table) {
+   typedef decltype(Entry().alias) Index;
+   size_t nitems(weights.size());
+   double total(0);
+   for (size_t i = 0; i < nitems; i++) {
+      total += weights[i];
+   }
+   std::vector<double> prob(nitems);
+   std::vector<Index> small, large;
+   for (size_t i = 0; i < nitems; i++) {
+      prob[i] = weights[i]*nitems/total;
+      if (prob[i] < 1) {
+         small.push_back(i);
+      } else {
+         large.push_back(i);
+      }
+   }
+   table.resize(nitems);
+   while (!small.empty() && !large.empty()) {
+      Index lo = small.back();
+      small.pop_back();
+      Index hi = large.back();
+      table[lo].prob = prob[lo];
+      table[lo].alias = hi;
+      prob[hi] -= 1. - prob[lo];
+      if (prob[hi] < 1) {
+         large.pop_back();
+         small.push_back(hi);
+      }
+   }
+// Whatever is left is full up to rounding error.
+   for (size_t i = 0; i < large.size(); i++) {
+      table[large[i]].prob = 1;
+      table[large[i]].alias = large[i];
+   }
+   for (size_t i = 0; i < small.size(); i++) {
+      table[small[i]].prob = 1;
+      table[small[i]].alias = small[i];
+   }
+   return total;
+}
+
+} // namespace genericSources
+
+#endif // genericSources_AliasTable_h
@@ -20,8 +20,9 @@ FileSpectrumMap::FileSpectrumMap(const std::string& params)
   : MapSource(params)
 {
   m_filespectrum = new FileSpectrum(params);
-  //Let FileSpectrum decide which flux to use
-  m_flux = m_filespectrum->flux();
+  //Let FileSpectrum decide which flux to use, scaled as MapSource
+  //does for a sub-map or region of interest
+  m_flux = m_filespectrum->flux()*m_fluxScale;
 
   facilities::Util::keyValueTokenize(params,",",m_parmap);
 
@@ -8,6 +8,8 @@
  */
 
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 
 #include <algorithm>
 #include <iostream>
@@ -15,13 +17,127 @@
 #include <sstream>
 #include <stdexcept>
 
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "Parallel.h"
 #include "Util.h"
 #include "FitsImage.h"
 
 namespace {
-   bool withinBounds(double value, std::vector<double> array) {
-      return ((array.front() < value && value < array.back()) || 
-              (array.back() < value && value < array.front()));
+/// @return The nbytes big-endian bytes at data as an unsigned integer.
+   unsigned long long bigEndian(const unsigned char * data, size_t nbytes) {
+      unsigned long long value(0);
+      for (size_t i = 0; i < nbytes; i++) {
+         value = (value << 8) | data[i];
+      }
+      return value;
+   }
+
+   double pixelValue(const unsigned char * data, int bitpix) {
+      switch (bitpix) {
+      case 8:
+         return data[0];
+      case 16:
+         return static_cast<short>(bigEndian(data, 2));
+      case 32:
+         return static_cast<int>(bigEndian(data, 4));
+      case 64:
+         return static_cast<long long>(bigEndian(data, 8));
+      case -32: {
+         unsigned int bits(bigEndian(data, 4));
+         float value;
+         std::memcpy(&value, &bits, sizeof(value));
+         return value;
+      }
+      default: {
+         unsigned long long bits(bigEndian(data, 8));
+         double value;
+         std::memcpy(&value, &bits, sizeof(value));
+         return value;
+      }
+      }
+   }
+
+/// Decode the pixels of an uncompressed primary image directly from a
+/// read-only mapping of the file, so that they are read from the page
+/// cache shared by all processes using the file rather than through
+/// the cfitsio buffers.  If the image cannot be read this way (a
+/// compressed file or image, an extension, integer data with BLANK
+/// values), image is left untouched and false is returned.
+   bool readMappedImage(fitsfile * fptr, const std::string & filename,
+                        long npixels, std::vector<double> & image) {
+#ifndef WIN32
+      int status(0);
+      int hdunum(0);
+      fits_get_hdu_num(fptr, &hdunum);
+      if (hdunum != 1 || filename.find('[') != std::string::npos
+          || fits_is_compressed_image(fptr, &status) || status != 0) {
+         return false;
+      }
+      int bitpix(0);
+      fits_get_img_type(fptr, &bitpix, &status);
+      char comment[80];
+      long blank;
+      fits_read_key_lng(fptr, "BLANK", &blank, comment, &status);
+      if (status == 0 && bitpix > 0) {
+         return false;
+      }
+      status = 0;
+      double bscale(1), bzero(0);
+      fits_read_key_dbl(fptr, "BSCALE", &bscale, comment, &status);
+      status = 0;
+      fits_read_key_dbl(fptr, "BZERO", &bzero, comment, &status);
+      status = 0;
+      LONGLONG headstart, datastart, dataend;
+      fits_get_hduaddrll(fptr, &headstart, &datastart, &dataend, &status);
+      if (status != 0) {
+         return false;
+      }
+      size_t nbytes(std::abs(bitpix)/8);
+      size_t size(datastart + npixels*nbytes);
+
+      int fd(open(filename.c_str(), O_RDONLY));
+      if (fd < 0) {
+         return false;
+      }
+      struct stat info;
+      if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < size) {
+         close(fd);
+         return false;
+      }
+      void * map(mmap(0, size, PROT_READ, MAP_SHARED, fd, 0));
+      close(fd);
+      if (map == MAP_FAILED) {
+         return false;
+      }
+// A gzipped file is inflated by cfitsio, so its offsets do not refer
+// to the file on disk.
+      const unsigned char * data = static_cast<const unsigned char *>(map);
+      if (std::memcmp(data, "SIMPLE", 6) != 0) {
+         munmap(map, size);
+         return false;
+      }
+      madvise(map, size, MADV_SEQUENTIAL);
+      image.resize(npixels);
+      data += datastart;
+      for (long i = 0; i < npixels; i++, data += nbytes) {
+         image[i] = bzero + bscale*pixelValue(data, bitpix);
+      }
+      munmap(map, size);
+      return true;
+#else
+      (void)(fptr);
+      (void)(filename);
+      (void)(npixels);
+      (void)(image);
+      return false;
+#endif
    }
 }
 namespace genericSources {
@@ -59,28 +175,162 @@ double FitsImage::operator()(const astro::SkyDir & dir, size_t iz) const {
    } else {
       throw std::runtime_error("Unknown coordinate system in FitsImage");
    }
+   long indx(pixelIndex(lon, lat));
+   if (indx < 0) {
+      return 0;
+   }
+   size_t offset(0);
+   if (m_axes.size() == 3) {
+      offset = iz*m_axes.at(0).size*m_axes.at(1).size;
+   }
+   if (offset + indx >= m_image.size()) {
+      return 0;
+   }
+   return m_image[offset + indx];
+}
+
+int FitsImage::lonIndex(double lon) const {
 // Kluge to account for maps spanning either (-180, 180) or (0, 360).
-   if (withinBounds(lon - 360., m_axisVectors.at(0))) {
-      lon -= 360.;
-   } else if (withinBounds(lon + 360., m_axisVectors.at(0))) {
-      lon += 360.;
-   }
-   size_t ix = std::upper_bound(m_axisVectors.at(0).begin(),
-                                m_axisVectors.at(0).end(), lon) - 
-      m_axisVectors.at(0).begin();
-   size_t iy = std::upper_bound(m_axisVectors.at(1).begin(),
-                                m_axisVectors.at(1).end(), lat) - 
-      m_axisVectors.at(1).begin();
-   try {
-      size_t offset(0);
-      if (m_axes.size() == 3) {
-         offset = iz*m_axes.at(0).size*m_axes.at(1).size;
+   int indx(m_axes.at(0).pixelIndex(lon));
+   if (indx < 0) {
+      indx = m_axes.at(0).pixelIndex(lon - 360.);
+   }
+   if (indx < 0) {
+      indx = m_axes.at(0).pixelIndex(lon + 360.);
+   }
+   return indx;
+}
+
+long FitsImage::pixelIndex(double lon, double lat) const {
+   int ix(lonIndex(lon));
+   int iy(m_axes.at(1).pixelIndex(lat));
+   if (ix < 0 || iy < 0) {
+      return -1;
+   }
+   return static_cast<long>(iy)*m_axes[0].size + ix;
+}
+
+FitsImage FitsImage::emptyImage(const std::vector<double> & longitudes,
+                                const std::vector<double> & latitudes,
+                                astro::SkyDir::CoordSystem coordSys) {
+   FitsImage my_image;
+
+   my_image.m_filename = "from Functor";
+
+   my_image.m_coordSys = coordSys;
+
+   std::string lonType("GLON-CAR");
+   std::string latType("GLAT-CAR");
+
+   if (coordSys == astro::SkyDir::EQUATORIAL) {
+      lonType = "RA---CAR";
+      latType = "DEC--CAR";
+   }
+
+   my_image.m_axes.push_back(AxisParams(longitudes, lonType));
+   my_image.m_axes.push_back(AxisParams(latitudes, latType));
+
+   my_image.m_axisVectors.push_back(longitudes);
+   my_image.m_axisVectors.push_back(latitudes);
+
+   return my_image;
+}
+
+FitsImage FitsImage::sampledImage(const FitsImage & image,
+                                  const std::vector<double> & longitudes,
+                                  const std::vector<double> & latitudes,
+                                  astro::SkyDir::CoordSystem coordSys) {
+   FitsImage my_image(emptyImage(longitudes, latitudes, coordSys));
+
+   size_t nx(longitudes.size());
+   size_t ny(latitudes.size());
+// Rows per thread, so that each thread gets at least s_minPixels.
+   const size_t s_minPixels(65536);
+   size_t minRows(std::max(size_t(1), s_minPixels/std::max(size_t(1), nx)));
+
+// Index in the image plane of the pixel sampled at each grid point.
+   std::vector<long> indices(nx*ny);
+   if (coordSys == image.m_coordSys) {
+      std::vector<int> ix(nx), iy(ny);
+      for (size_t i = 0; i < nx; i++) {
+         ix[i] = image.lonIndex(longitudes[i]);
       }
-      return m_image.at(offset + iy*m_axes.at(0).size + ix);
-   } catch (...) {
-      return 0;
+      for (size_t j = 0; j < ny; j++) {
+         iy[j] = image.m_axes.at(1).pixelIndex(latitudes[j]);
+      }
+      long nx_image(image.m_axes.at(0).size);
+      for (size_t j = 0; j < ny; j++) {
+         for (size_t i = 0; i < nx; i++) {
+            indices[j*nx + i] = (ix[i] < 0 || iy[j] < 0) ? -1
+               : iy[j]*nx_image + ix[i];
+         }
+      }
+   } else {
+// Rotation from the grid frame to the image frame: its columns are the
+// grid frame basis vectors expressed in the image frame.
+      double rotation[3][3];
+      double basis[3][2] = {{0, 0}, {90, 0}, {0, 90}};
+      for (size_t k = 0; k < 3; k++) {
+         astro::SkyDir dir(basis[k][0], basis[k][1], coordSys);
+         double lon(dir.ra()*M_PI/180.), lat(dir.dec()*M_PI/180.);
+         if (image.m_coordSys == astro::SkyDir::GALACTIC) {
+            lon = dir.l()*M_PI/180.;
+            lat = dir.b()*M_PI/180.;
+         }
+         rotation[0][k] = std::cos(lat)*std::cos(lon);
+         rotation[1][k] = std::cos(lat)*std::sin(lon);
+         rotation[2][k] = std::sin(lat);
+      }
+      std::vector<double> coslon(nx), sinlon(nx);
+      for (size_t i = 0; i < nx; i++) {
+         coslon[i] = std::cos(longitudes[i]*M_PI/180.);
+         sinlon[i] = std::sin(longitudes[i]*M_PI/180.);
+      }
+      forEachChunk(ny, minRows, [&](size_t first, size_t last) {
+            for (size_t j = first; j < last; j++) {
+               double coslat(std::cos(latitudes[j]*M_PI/180.));
+               double sinlat(std::sin(latitudes[j]*M_PI/180.));
+               for (size_t i = 0; i < nx; i++) {
+                  double v[3] = {coslat*coslon[i], coslat*sinlon[i], sinlat};
+                  double w[3];
+                  for (size_t m = 0; m < 3; m++) {
+                     w[m] = (rotation[m][0]*v[0] + rotation[m][1]*v[1]
+                             + rotation[m][2]*v[2]);
+                  }
+                  double lon(std::atan2(w[1], w[0])*180./M_PI);
+                  if (lon < 0) {
+                     lon += 360.;
+                  }
+                  double lat(std::asin(std::max(-1., std::min(1., w[2])))
+                             *180./M_PI);
+                  indices[j*nx + i] = image.pixelIndex(lon, lat);
+               }
+            }
+         });
+   }
+
+   size_t nz(1);
+   if (image.m_axes.size() == 3) {
+      my_image.m_axes.push_back(image.m_axes.at(2));
+      my_image.m_axisVectors.push_back(image.m_axisVectors.at(2));
+      nz = my_image.m_axes.at(2).size;
    }
-   return 0;
+   size_t plane(static_cast<size_t>(image.m_axes.at(0).size)
+                *image.m_axes.at(1).size);
+   my_image.m_image.resize(nz*nx*ny);
+   const double * data = image.m_image.empty() ? 0 : &image.m_image[0];
+   double * sampled = my_image.m_image.empty() ? 0 : &my_image.m_image[0];
+   forEachChunk(ny, minRows, [&](size_t first, size_t last) {
+         for (size_t k = 0; k < nz; k++) {
+            for (size_t p = first*nx; p < last*nx; p++) {
+               size_t indx(k*plane + indices[p]);
+               sampled[k*nx*ny + p] = (indices[p] < 0
+                                       || indx >= image.m_image.size())
+                  ? 0 : data[indx];
+            }
+         }
+      });
+   return my_image;
 }
 
 void FitsImage::getAxisDims(std::vector<int> &axisDims) {
@@ -144,6 +394,11 @@ void FitsImage::getImageData(std::vector<double> &imageData) {
    imageData = m_image;
 }
 
+void FitsImage::takeImageData(std::vector<double> &imageData) {
+   imageData.swap(m_image);
+   std::vector<double>().swap(m_image);
+}
+
 void FitsImage::
 AxisParams::computeAxisVector(std::vector<double> &axisVector) {
    axisVector.clear();
@@ -157,6 +412,17 @@ AxisParams::computeAxisVector(std::vector<double> &axisVector) {
    }
 }
 
+int FitsImage::AxisParams::pixelIndex(double value) const {
+   if (logScale) {
+      value = std::log(value);
+   }
+   double x((value - refVal)/step + refPixel - 1.);
+   if (!(x >= -0.5 && x < size - 0.5)) {
+      return -1;
+   }
+   return std::min(static_cast<int>(std::floor(x + 0.5)), size - 1);
+}
+
 double FitsImage::mapIntegral() const {
    std::vector<double> solidAngles;
    getSolidAngles(solidAngles);
@@ -261,24 +527,17 @@ void FitsImage::read_fits_image(std::string & filename,
    status = 0;
 
 // Read in the image pixels.
-   long group = 0;
-   long fpixel = 1;
-   double nullval = 0.;
-   int anynull;
-   double *tmpImage;
-   tmpImage = new double[npixels];
-   fits_read_img_dbl(fptr, group, fpixel, npixels, nullval, 
-                     tmpImage, &anynull, &status);
-   fitsReportError(status);
-
-   image.resize(npixels);
-
-   for (int i = 0; i < npixels; i++) {
-      image[i] = tmpImage[i];
+   if (!readMappedImage(fptr, filename, npixels, image)) {
+      long group = 0;
+      long fpixel = 1;
+      double nullval = 0.;
+      int anynull;
+      image.resize(npixels);
+      fits_read_img_dbl(fptr, group, fpixel, npixels, nullval, 
+                        &image[0], &anynull, &status);
+      fitsReportError(status);
    }
 
-   delete [] tmpImage;
-
    fits_close_file(fptr, &status);
    fitsReportError(status);
 }
@@ -70,6 +70,10 @@ public:
    /// (South-East) corner.
    virtual void getImageData(std::vector<double> & imageData);
 
+   /// Move the pixel values, indexed as for getImageData, into
+   /// imageData without copying them.  This image is left empty.
+   void takeImageData(std::vector<double> & imageData);
+
    /// This returns the pixel solid angles.  Use of this method assumes
    /// that m_axis[0] represents a longitudinal coordinate and that
    /// m_axis[1] represents a latitudinal coordinate.  The pixel values
@@ -88,6 +92,18 @@ public:
    static int findHdu(const std::string & fitsFile,
                       const std::string & extension);
 
+   /// Resample a FitsImage onto the grid of longitudes and latitudes
+   /// (degrees) in coordSys, taking the value of the nearest pixel.
+   /// The pixel indices are found by index arithmetic on the image
+   /// axes, once per grid column and row if the image uses coordSys,
+   /// or from a single rotation of every grid direction otherwise.
+   /// The rows are filled in parallel.
+   static FitsImage sampledImage(const FitsImage & image,
+                                 const std::vector<double> & longitudes,
+                                 const std::vector<double> & latitudes,
+                                 astro::SkyDir::CoordSystem coordSys);
+
+   /// Resample any functor taking a SkyDir and an image plane index.
    template <typename Functor>
    static FitsImage sampledImage(const Functor & functor, 
                                  const std::vector<double> & longitudes,
@@ -133,8 +149,26 @@ protected:
 
       /// Returns a vector of abscissa values based on the axis parameters.
       void computeAxisVector(std::vector<double> &axisVector);
+
+      /// @return Index of the pixel nearest to value, or -1 if value
+      ///         lies outside of the axis.
+      int pixelIndex(double value) const;
    };
 
+   /// @return Index within an image plane of the pixel nearest to
+   ///         (lon, lat) in the image coordinates, or -1 if it lies
+   ///         outside of the image.
+   long pixelIndex(double lon, double lat) const;
+
+   /// @return Index of the pixel nearest to lon along the first axis,
+   ///         accounting for maps spanning either (-180, 180) or (0, 360).
+   int lonIndex(double lon) const;
+
+   /// An image with the given longitude and latitude axes, and no data.
+   static FitsImage emptyImage(const std::vector<double> & longitudes,
+                               const std::vector<double> & latitudes,
+                               astro::SkyDir::CoordSystem coordSys);
+
    /// Interface to cfitsio routines.
    void read_fits_image(std::string &filename, std::vector<AxisParams> &axes,
                         std::vector<double> &image);
@@ -162,25 +196,7 @@ FitsImage FitsImage::sampledImage(const Functor & image,
                                   const std::vector<double> & longitudes,
                                   const std::vector<double> & latitudes,
                                   astro::SkyDir::CoordSystem coordSys) {
-   FitsImage my_image;
-
-   my_image.m_filename = "from Functor";
-
-   my_image.m_coordSys = coordSys;
-
-   std::string lonType("GLON-CAR");
-   std::string latType("GLAT-CAR");
-
-   if (coordSys == astro::SkyDir::EQUATORIAL) {
-      lonType = "RA---CAR";
-      latType = "DEC--CAR";
-   }
-
-   my_image.m_axes.push_back(AxisParams(longitudes, lonType));
-   my_image.m_axes.push_back(AxisParams(latitudes, latType));
-
-   my_image.m_axisVectors.push_back(longitudes);
-   my_image.m_axisVectors.push_back(latitudes);
+   FitsImage my_image(emptyImage(longitudes, latitudes, coordSys));
 
    size_t nz(1);
 /// @bug Using image.m_axes and indexing over k breaks polymorphism.
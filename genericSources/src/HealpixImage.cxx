@@ -0,0 +1,349 @@
+/**
+ * @file HealpixImage.cxx
+ * @brief Sky maps stored as HEALPix binary tables.
+ *
+ * $Header$
+ */
+
+#include <cmath>
+
+#include <sstream>
+#include <stdexcept>
+
+#include "fitsio.h"
+
+#include "FitsImage.h"
+#include "HealpixImage.h"
+
+namespace {
+/// Ring number, in units of nside, of the southernmost corner of each
+/// base face, and its longitude in units of pi/4.
+   const int s_jrll[] = {2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4};
+   const int s_jpll[] = {1, 3, 5, 7, 0, 2, 4, 6, 1, 3, 5, 7};
+
+/// Value flagging missing pixels in HEALPix maps.
+   const double s_unseen(-1.6375e30);
+
+   long long isqrt(long long value) {
+      long long root(static_cast<long long>(std::sqrt(value + 0.5)));
+      while (root*root > value) {
+         root--;
+      }
+      while ((root + 1)*(root + 1) <= value) {
+         root++;
+      }
+      return root;
+   }
+
+/// @return The bits of value in even positions, packed together.
+   long long evenBits(long long value) {
+      long long result(0);
+      for (int bit = 0; value != 0; bit++, value >>= 2) {
+         result |= (value & 1) << bit;
+      }
+      return result;
+   }
+
+   std::string keyword(fitsfile * fptr, const std::string & name,
+                       int & status) {
+      char value[72];
+      char comment[72];
+      fits_read_key_str(fptr, const_cast<char *>(name.c_str()), value,
+                        comment, &status);
+      if (status == KEY_NO_EXIST) {
+         status = 0;
+         return "";
+      }
+      return value;
+   }
+}
+
+namespace genericSources {
+
+HealpixImage::HealpixImage(const std::string & filename)
+   : m_nside(0), m_nested(false), m_coordSys(astro::SkyDir::GALACTIC),
+     m_npix(0), m_nplanes(0) {
+   std::string routineName("HealpixImage::HealpixImage");
+   int hdu(findHdu(filename));
+   if (hdu == 0) {
+      throw std::runtime_error(routineName + ": no HEALPix table found in "
+                               + filename);
+   }
+   int status(0);
+   fitsfile * fptr = 0;
+   fits_open_file(&fptr, filename.c_str(), READONLY, &status);
+   FitsImage::fitsReportError(status, routineName);
+
+   int hdutype(0);
+   fits_movabs_hdu(fptr, hdu, &hdutype, &status);
+   FitsImage::fitsReportError(status, routineName);
+
+   fits_read_key(fptr, TLONG, "NSIDE", &m_nside, 0, &status);
+   FitsImage::fitsReportError(status, routineName);
+
+   std::string ordering(keyword(fptr, "ORDERING", status));
+   std::string coordsys(keyword(fptr, "COORDSYS", status));
+   std::string indxschm(keyword(fptr, "INDXSCHM", status));
+   FitsImage::fitsReportError(status, routineName);
+
+   if (ordering.find("NEST") == 0) {
+      m_nested = true;
+   } else if (ordering.find("RING") != 0) {
+      throw std::runtime_error(routineName + ": unknown ORDERING "
+                               + ordering + " in " + filename);
+   }
+   if (m_nside <= 0 || (m_nested && (m_nside & (m_nside - 1)) != 0)) {
+      std::ostringstream message;
+      message << routineName << ": invalid NSIDE " << m_nside
+              << " in " << filename;
+      throw std::runtime_error(message.str());
+   }
+// HEALPix uses G and C; Fermi maps use GAL and CEL or EQU.
+   if (coordsys == "" || coordsys[0] == 'G') {
+      m_coordSys = astro::SkyDir::GALACTIC;
+   } else if (coordsys[0] == 'C' || coordsys.find("EQU") == 0) {
+      m_coordSys = astro::SkyDir::EQUATORIAL;
+   } else {
+      throw std::runtime_error(routineName + ": unsupported COORDSYS "
+                               + coordsys + " in " + filename);
+   }
+
+   long nrows(0);
+   fits_get_num_rows(fptr, &nrows, &status);
+   int ncols(0);
+   fits_get_num_cols(fptr, &ncols, &status);
+   FitsImage::fitsReportError(status, routineName);
+
+   int pixelCol(0);
+   if (indxschm.find("EXPLICIT") == 0) {
+      fits_get_colnum(fptr, CASEINSEN, const_cast<char *>("PIXEL"),
+                      &pixelCol, &status);
+      FitsImage::fitsReportError(status, routineName);
+      std::vector<double> pixels;
+      FitsImage::readColumn(fptr, "PIXEL", pixels);
+      m_pixels.assign(pixels.begin(), pixels.end());
+      m_npix = m_pixels.size();
+   } else {
+      m_npix = 12*static_cast<size_t>(m_nside)*m_nside;
+   }
+
+   std::vector<int> planeCols;
+   for (int col = 1; col <= ncols; col++) {
+      if (col == pixelCol) {
+         continue;
+      }
+      int typecode(0);
+      long repeat(0), width(0);
+      fits_get_coltype(fptr, col, &typecode, &repeat, &width, &status);
+      FitsImage::fitsReportError(status, routineName);
+      if (static_cast<size_t>(nrows)*repeat != m_npix) {
+         std::ostringstream message;
+         message << routineName << ": column " << col << " of " << filename
+                 << " has " << nrows*repeat << " pixels; "
+                 << m_npix << " were expected.";
+         throw std::runtime_error(message.str());
+      }
+      planeCols.push_back(col);
+   }
+   m_nplanes = planeCols.size();
+   if (m_nplanes == 0) {
+      throw std::runtime_error(routineName + ": no map columns in "
+                               + filename);
+   }
+
+   m_image.resize(m_nplanes*m_npix);
+   for (size_t k = 0; k < m_nplanes; k++) {
+      int anynul(0);
+      double nulval(0);
+      fits_read_col(fptr, TDOUBLE, planeCols[k], 1, 1, m_npix, &nulval,
+                    &m_image[k*m_npix], &anynul, &status);
+      FitsImage::fitsReportError(status, routineName);
+   }
+   fits_close_file(fptr, &status);
+   FitsImage::fitsReportError(status, routineName);
+
+   for (size_t i = 0; i < m_image.size(); i++) {
+      if (m_image[i] != m_image[i] || m_image[i] <= s_unseen*0.99) {
+         m_image[i] = 0;
+      }
+   }
+}
+
+int HealpixImage::findHdu(const std::string & filename) {
+   std::string routineName("HealpixImage::findHdu");
+   int status(0);
+   fitsfile * fptr = 0;
+   fits_open_file(&fptr, filename.c_str(), READONLY, &status);
+   FitsImage::fitsReportError(status, routineName);
+
+   int nhdus(0);
+   fits_get_num_hdus(fptr, &nhdus, &status);
+   FitsImage::fitsReportError(status, routineName);
+
+   int found(0);
+   int hdutype(0);
+   for (int hdu = 2; hdu < nhdus + 1 && found == 0; hdu++) {
+      fits_movabs_hdu(fptr, hdu, &hdutype, &status);
+      FitsImage::fitsReportError(status, routineName);
+      if (hdutype == BINARY_TBL
+          && keyword(fptr, "PIXTYPE", status).find("HEALPIX") == 0) {
+         found = hdu;
+      }
+      FitsImage::fitsReportError(status, routineName);
+   }
+   fits_close_file(fptr, &status);
+   FitsImage::fitsReportError(status, routineName);
+   return found;
+}
+
+void HealpixImage::getSolidAngles(std::vector<double> & solidAngles) const {
+   solidAngles.assign(m_npix, 4.*M_PI/(12.*m_nside*m_nside));
+}
+
+void HealpixImage::takeImageData(std::vector<double> & imageData) {
+   imageData.swap(m_image);
+   std::vector<double>().swap(m_image);
+}
+
+double HealpixImage::mapIntegral() const {
+   double map_integral(0);
+   for (size_t i = 0; i < m_npix; i++) {
+      map_integral += m_image[i];
+   }
+   return map_integral*4.*M_PI/(12.*m_nside*m_nside);
+}
+
+void HealpixImage::selectPixels(double lonMin, double lonMax,
+                                double latMin, double latMax) {
+   std::vector<long long> pixels;
+   std::vector<size_t> selected;
+   for (size_t i = 0; i < m_npix; i++) {
+      long long pixel(m_pixels.empty() ? i : m_pixels[i]);
+      double lon, lat;
+      pixelDirection(m_nside, m_nested, pixel, 0.5, 0.5, lon, lat);
+      double dlon(std::fmod(lon - lonMin, 360.));
+      if (dlon < 0) {
+         dlon += 360.;
+      }
+      if (latMin <= lat && lat <= latMax
+          && (dlon <= lonMax - lonMin || lonMax - lonMin >= 360.)) {
+         pixels.push_back(pixel);
+         selected.push_back(i);
+      }
+   }
+   if (selected.empty()) {
+      throw std::runtime_error("HealpixImage::selectPixels: "
+                               "no pixels within the sub-map bounds");
+   }
+   std::vector<double> image(m_nplanes*selected.size());
+   for (size_t k = 0; k < m_nplanes; k++) {
+      for (size_t i = 0; i < selected.size(); i++) {
+         image[k*selected.size() + i] = m_image[k*m_npix + selected[i]];
+      }
+   }
+   m_pixels.swap(pixels);
+   m_image.swap(image);
+   m_npix = selected.size();
+}
+
+void HealpixImage::pixelDirection(long nside, bool nested, long long pixel,
+                                  double x, double y,
+                                  double & lon, double & lat) {
+   int face;
+   long long ix, iy;
+   pixelToFace(nside, nested, pixel, face, ix, iy);
+   double fx((ix + x)/nside);
+   double fy((iy + y)/nside);
+
+// The equal-area HEALPix projection of Gorski et al. (2005, ApJ, 622,
+// 759), applied to the position within the base face.
+   double jr(s_jrll[face] - fx - fy);
+   double nr, z, sth;
+   if (jr < 1) {
+      nr = jr;
+      double tmp(nr*nr/3.);
+      z = 1. - tmp;
+      sth = std::sqrt(tmp*(2. - tmp));
+   } else if (jr > 3) {
+      nr = 4. - jr;
+      double tmp(nr*nr/3.);
+      z = tmp - 1.;
+      sth = std::sqrt(tmp*(2. - tmp));
+   } else {
+      nr = 1;
+      z = (2. - jr)*2./3.;
+      sth = std::sqrt((1. - z)*(1. + z));
+   }
+   double tmp(s_jpll[face]*nr + fx - fy);
+   if (tmp < 0) {
+      tmp += 8;
+   }
+   if (tmp >= 8) {
+      tmp -= 8;
+   }
+   double phi(nr < 1e-15 ? 0 : M_PI/4.*tmp/nr);
+   lon = phi*180./M_PI;
+   if (lon >= 360.) {
+      lon -= 360.;
+   }
+   lat = std::atan2(z, sth)*180./M_PI;
+}
+
+void HealpixImage::pixelToFace(long nside, bool nested, long long pixel,
+                               int & face, long long & ix, long long & iy) {
+   long long npix(12LL*nside*nside);
+   if (pixel < 0 || pixel >= npix) {
+      std::ostringstream message;
+      message << "HealpixImage: pixel " << pixel
+              << " is out of range for NSIDE " << nside;
+      throw std::runtime_error(message.str());
+   }
+   if (nested) {
+      long long npface(static_cast<long long>(nside)*nside);
+      face = pixel/npface;
+      long long ipf(pixel % npface);
+      ix = evenBits(ipf);
+      iy = evenBits(ipf >> 1);
+      return;
+   }
+// Ring scheme: find the ring and the position along it, then the face.
+   long long nl2(2*nside);
+   long long ncap(2LL*nside*(nside - 1));
+   long long iring, iphi, kshift, nr;
+   if (pixel < ncap) {
+      iring = (1 + isqrt(1 + 2*pixel)) >> 1;
+      iphi = (pixel + 1) - 2*iring*(iring - 1);
+      kshift = 0;
+      nr = iring;
+      face = (iphi - 1)/nr;
+   } else if (pixel < npix - ncap) {
+      long long ip(pixel - ncap);
+      long long tmp(ip/(4*nside));
+      iring = tmp + nside;
+      iphi = ip - tmp*4*nside + 1;
+      kshift = (iring + nside) & 1;
+      nr = nside;
+      long long ire(tmp + 1);
+      long long irm(nl2 + 1 - tmp);
+      long long ifm((iphi - (ire >> 1) + nside - 1)/nside);
+      long long ifp((iphi - (irm >> 1) + nside - 1)/nside);
+      face = (ifp == ifm) ? (ifp | 4) : ((ifp < ifm) ? ifp : (ifm + 8));
+   } else {
+      long long ip(npix - pixel);
+      iring = (1 + isqrt(2*ip - 1)) >> 1;
+      iphi = 4*iring + 1 - (ip - 2*iring*(iring - 1));
+      kshift = 0;
+      nr = iring;
+      iring = 2*nl2 - iring;
+      face = (iphi - 1)/nr + 8;
+   }
+   long long irt(iring - (2 + (face >> 2))*nside + 1);
+   long long ipt(2*iphi - s_jpll[face]*nr - kshift - 1);
+   if (ipt >= nl2) {
+      ipt -= 8*nside;
+   }
+   ix = (ipt - irt)/2;
+   iy = (-ipt - irt)/2;
+}
+
+} // namespace genericSources
@@ -0,0 +1,113 @@
+/**
+ * @file HealpixImage.h
+ * @brief Sky maps stored as HEALPix binary tables.
+ *
+ * $Header$
+ */
+
+#ifndef genericSources_HealpixImage_h
+#define genericSources_HealpixImage_h
+
+#include <string>
+#include <vector>
+
+#include "astro/SkyDir.h"
+
+namespace genericSources {
+
+/**
+ * @class HealpixImage
+ * @brief A sky map, or a cube of sky maps, read from the first binary
+ * table of a FITS file with PIXTYPE = 'HEALPIX'.  Both RING and NESTED
+ * ordering are supported, as are the implicit (full sky, possibly with
+ * several pixels per row) and explicit (a PIXEL column listing the
+ * pixels present) indexing schemes.  Every column other than PIXEL is
+ * an image plane, e.g., the CHANNEL1...CHANNELn columns of a map cube.
+ * NaN and UNSEEN pixels are set to zero.
+ *
+ * Since HEALPix pixels have equal areas, and are squares in the
+ * equal-area HEALPix projection, a point drawn uniformly within the
+ * square is uniformly distributed within the pixel on the sky.
+ */
+
+class HealpixImage {
+
+public:
+
+   HealpixImage(const std::string & filename);
+
+   /// @return The HDU number of the HEALPix table, or 0 if the file
+   ///         has none.
+   static int findHdu(const std::string & filename);
+
+   static bool isHealpix(const std::string & filename) {
+      return findHdu(filename) > 0;
+   }
+
+   long nside() const {
+      return m_nside;
+   }
+
+   bool nested() const {
+      return m_nested;
+   }
+
+   astro::SkyDir::CoordSystem coordSys() const {
+      return m_coordSys;
+   }
+
+   /// @return The HEALPix pixel numbers of the map pixels.  This is
+   ///         empty for a full-sky map, where map pixel i is pixel i.
+   const std::vector<long long> & pixels() const {
+      return m_pixels;
+   }
+
+   /// @return Number of map pixels in each plane.
+   size_t numPixels() const {
+      return m_npix;
+   }
+
+   /// The pixel solid angles (sr), which are all 4 pi/(12 nside^2).
+   void getSolidAngles(std::vector<double> & solidAngles) const;
+
+   /// Move the pixel values, indexed by map pixel then plane, into
+   /// imageData without copying them.
+   void takeImageData(std::vector<double> & imageData);
+
+   /// @return The integral over solid angle of the first plane.
+   double mapIntegral() const;
+
+   /// Keep only the pixels with centres within the given bounds, in
+   /// degrees.  The longitude range wraps around 360.
+   void selectPixels(double lonMin, double lonMax,
+                     double latMin, double latMax);
+
+   /// Find the direction of the point (x, y) within a pixel, where x
+   /// and y run over the unit interval along the pixel edges and
+   /// (0.5, 0.5) is its centre.
+   /// @param lon Longitude in degrees on [0, 360).
+   /// @param lat Latitude in degrees.
+   static void pixelDirection(long nside, bool nested, long long pixel,
+                              double x, double y, double & lon, double & lat);
+
+private:
+
+   long m_nside;
+   bool m_nested;
+   astro::SkyDir::CoordSystem m_coordSys;
+
+   std::vector<long long> m_pixels;
+   size_t m_npix;
+   size_t m_nplanes;
+
+   std::vector<double> m_image;
+
+   /// Find the base face of a pixel and its position (ix, iy) in it.
+   static void pixelToFace(long nside, bool nested, long long pixel,
+                           int & face, long long & ix, long long & iy);
+
+};
+
+} // namespace genericSources
+
+#endif // genericSources_HealpixImage_h
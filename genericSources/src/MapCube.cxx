@@ -26,6 +26,8 @@
 #include "flux/EventSource.h"
 
 #include "FitsImage.h"
+#include "MapIndex.h"
+#include "Parallel.h"
 #include "Util.h"
 
 #include "celestialSources/ConstParMap.h"
@@ -37,7 +39,15 @@ ISpectrumFactory & MapCubeFactory() {
    return myFactory;
 }
 
-MapCube::MapCube(const std::string & paramString) : MapSource() {
+namespace {
+/// Pixels processed together in each energy plane, and the fewest
+/// pixels worth a thread of their own.
+   const size_t s_pixelBlock(256);
+   const size_t s_minPixels(4096);
+}
+
+MapCube::MapCube(const std::string & paramString) 
+   : MapSource(), m_spectraData(0), m_firstInterval(0), m_lastInterval(0) {
 
    std::string fitsFile;
    bool createSubMap(false);
@@ -66,7 +76,20 @@ MapCube::MapCube(const std::string & paramString) : MapSource() {
       
       m_flux = parmap.value("flux");
       fitsFile = parmap["fitsFile"];
-      if (parmap.size() > 2) {
+      if (parmap.find("pixelSampler") != parmap.end()) {
+         setPixelSampler(parmap["pixelSampler"]);
+      }
+      setRegion(parmap);
+      if (parmap.find("emin") != parmap.end()) {
+         m_emin = parmap.value("emin");
+      }
+      if (parmap.find("emax") != parmap.end()) {
+         m_emax = parmap.value("emax");
+      }
+      if (parmap.find("lonMin") != parmap.end() ||
+          parmap.find("lonMax") != parmap.end() ||
+          parmap.find("latMin") != parmap.end() ||
+          parmap.find("latMax") != parmap.end()) {
          try {
             m_lonMin = parmap.value("lonMin");
             m_lonMax = parmap.value("lonMax");
@@ -83,20 +106,76 @@ MapCube::MapCube(const std::string & paramString) : MapSource() {
 
    facilities::Util::expandEnvVar(&fitsFile);
 
+   std::ostringstream kind;
+   kind.precision(17);
+   kind << "MapCube";
+   if (m_emin > 0 || m_emax > 0) {
+      kind << " emin=" << m_emin << " emax=" << m_emax;
+   }
+
+// The energies and spectra follow the MapSource sections of the index.
+   std::string key(indexKey(fitsFile, kind.str(), createSubMap));
+   if (loadIndex(key, s_indexSections + 2)) {
+      size_t n;
+      const double * energies = m_index->section<double>(s_indexSections, n);
+      m_energies.assign(energies, energies + n);
+      m_spectraData = m_index->section<float>(s_indexSections + 1, n);
+      setEnergyBand();
+      return;
+   }
+
    readFitsFile(fitsFile, createSubMap);
    checkForNonPositivePixels(fitsFile);
    readEnergyVector(fitsFile);
+   setEnergyBand();
    makeCumulativeSpectra();
-   std::vector<double> totalCounts(m_solidAngles.size());
+   size_t nee(m_energies.size());
+   std::vector<double> pixelCounts(m_solidAngles.size());
    for (unsigned int i = 0; i < m_solidAngles.size(); i++) {
-      totalCounts[i] = m_spectra[i].back().first;
+      pixelCounts[i] = spectrum(i)[nee - 1];
+   }
+   if (m_emax > 0) {
+// Sample the pixels from the counts within the band, and scale the
+// flux by the fraction of the counts that lie in the band.
+      double totalIntegral(0);
+      for (unsigned int i = firstPixel(); i < m_solidAngles.size(); i++) {
+         totalIntegral += m_solidAngles[i]*pixelCounts[i];
+      }
+      for (unsigned int i = 0; i < m_solidAngles.size(); i++) {
+         pixelCounts[i] = (cumulativeCounts(spectrum(i), m_emax)
+                           - cumulativeCounts(spectrum(i), m_emin));
+      }
+      makeIntegralDistribution(pixelCounts);
+      double bandScale(m_mapIntegral/totalIntegral);
+      m_fluxScale *= bandScale;
+      m_flux *= bandScale;
+   } else {
+      makeIntegralDistribution(pixelCounts);
    }
-   makeIntegralDistribution(totalCounts);
+   releasePixelArrays();
+
+   std::vector<IndexSection> sections;
+   sections.push_back(IndexSection(&m_energies[0],
+                                   m_energies.size()*sizeof(double)));
+   sections.push_back(IndexSection(&m_spectra[0],
+                                   m_spectra.size()*sizeof(float)));
+   saveIndex(key, sections);
 
 //    std::cerr << "Integral over the map: " 
 //              << m_mapIntegral << std::endl;
 }
 
+bool MapCube::validIndex(const genericSources::MapIndex & index,
+                         size_t & npix) const {
+   if (!MapSource::validIndex(index, npix)) {
+      return false;
+   }
+   size_t nee, nspectra;
+   index.section<double>(s_indexSections, nee);
+   index.section<float>(s_indexSections + 1, nspectra);
+   return nee > 0 && nspectra == npix*(2*nee - 1);
+}
+
 void MapCube::checkForNonPositivePixels(const std::string & fitsFile) const {
    std::vector<double>::const_iterator pixel = m_image.begin();
    for ( ; pixel != m_image.end(); ++pixel) {
@@ -111,9 +190,7 @@ void MapCube::checkForNonPositivePixels(const std::string & fitsFile) const {
 }
 
 float MapCube::operator()(float xi) const {
-   std::vector<double>::const_iterator it 
-      = std::upper_bound(m_integralDist.begin(), m_integralDist.end(), xi);
-   unsigned int indx = it - m_integralDist.begin();
+   unsigned int indx = drawPixel(xi);
 
    double lon, lat;
    samplePixel(indx, lon, lat);
@@ -124,7 +201,7 @@ float MapCube::operator()(float xi) const {
    } else { // assume Galactic coordinates
       m_currentDir = std::make_pair(lon, lat);
    }
-   float energy = drawEnergy(m_spectra[indx]);
+   float energy = drawEnergy(spectrum(indx));
    return energy;
 }
 
@@ -134,11 +211,6 @@ double MapCube::energy(double time) {
    return (*this)(xi);
 }
 
-double MapCube::mapValue(unsigned int i, unsigned int j, unsigned int k) {
-   unsigned int indx = k*m_lon.size()*m_lat.size() + j*m_lon.size() + i;
-   return m_image.at(indx);
-}
-
 void MapCube::readEnergyVector(const std::string & fitsFile) {
 
    std::string routineName("MapCube::readEnergyVector");
@@ -162,58 +234,133 @@ void MapCube::readEnergyVector(const std::string & fitsFile) {
 }
 
 void MapCube::makeCumulativeSpectra() {
-   m_spectra.clear();
-   m_spectra.reserve(m_solidAngles.size());
-
-   for (unsigned int j = 0; j < m_lat.size(); j++) {
-      for (unsigned int i = 0; i < m_lon.size(); i++) {
-         Spectrum_t counts_spectrum;
-         counts_spectrum.reserve(m_energies.size());
-         counts_spectrum.push_back(std::make_pair(0, -2));
-         for (unsigned int k = 1; k < m_energies.size(); k++) {
-            double gamma;
-            double counts = counts_spectrum[k-1].first + 
-               powerLawIntegral(m_energies.at(k-1), m_energies.at(k),
-                                mapValue(i, j, k-1), mapValue(i, j, k),
-                                gamma);
-            counts_spectrum.push_back(std::make_pair(counts, gamma));
+   size_t nee(m_energies.size());
+   size_t npix(m_solidAngles.size());
+   if (m_image.size() < nee*npix) {
+      throw std::runtime_error("MapCube::makeCumulativeSpectra:\n"
+                               + std::string("image has fewer planes ")
+                               + "than the number of energies");
+   }
+   m_spectra.resize(npix*spectrumSize());
+   m_spectraData = &m_spectra[0];
+
+   std::vector<double> logRatios(nee);
+   for (size_t k = 1; k < nee; k++) {
+      logRatios[k] = std::log(m_energies[k]/m_energies[k-1]);
+   }
+   const double * image = &m_image[0];
+
+// Each energy plane of the image is contiguous, so the pixels are
+// processed in blocks, one plane at a time, to keep the inner loops
+// over contiguous data.  Over each energy interval the spectrum is the
+// power-law y1*(x/x1)^gamma, with integral y1*x1*L*(e^u - 1)/u, where
+// L = log(x2/x1) and u = (gamma + 1)*L.
+   genericSources::forEachChunk(npix, s_minPixels,
+                                [&](size_t first, size_t last) {
+         std::vector<double> logValues(nee*s_pixelBlock);
+         std::vector<double> cumulative(s_pixelBlock);
+         for (size_t begin = first; begin < last; begin += s_pixelBlock) {
+            size_t n(std::min(s_pixelBlock, last - begin));
+            for (size_t k = 0; k < nee; k++) {
+               const double * values = image + k*npix + begin;
+               double * logs = &logValues[k*s_pixelBlock];
+               for (size_t i = 0; i < n; i++) {
+                  logs[i] = std::log(values[i]);
+               }
+            }
+            std::fill(cumulative.begin(), cumulative.begin() + n, 0);
+            for (size_t i = 0; i < n; i++) {
+               m_spectra[(begin + i)*spectrumSize()] = 0;
+            }
+            for (size_t k = 1; k < nee; k++) {
+               const double * y1 = image + (k - 1)*npix + begin;
+               const double * logs1 = &logValues[(k - 1)*s_pixelBlock];
+               const double * logs2 = &logValues[k*s_pixelBlock];
+               double x1L(m_energies[k-1]*logRatios[k]);
+               for (size_t i = 0; i < n; i++) {
+                  double gamma((logs2[i] - logs1[i])/logRatios[k]);
+                  double u((gamma + 1.)*logRatios[k]);
+                  cumulative[i] += y1[i]*x1L*(u != 0 ? std::expm1(u)/u : 1.);
+                  float * counts = &m_spectra[(begin + i)*spectrumSize()];
+                  counts[k] = cumulative[i];
+                  counts[nee + k - 1] = gamma;
+               }
+            }
          }
-         m_spectra.push_back(counts_spectrum);
-      }
+      });
+}
+
+void MapCube::setEnergyBand() {
+   size_t nee(m_energies.size());
+   m_firstInterval = 0;
+   m_lastInterval = nee - 2;
+   if (m_emin <= 0 && m_emax <= 0) {
+      return;
+   }
+   m_emin = std::max(m_emin, m_energies.front());
+   m_emax = m_emax > 0 ? std::min(m_emax, m_energies.back())
+      : m_energies.back();
+   if (m_emin >= m_emax) {
+      std::ostringstream message;
+      message << "MapCube: the energy band [emin, emax] does not overlap "
+              << "the energies of the map cube, "
+              << m_energies.front() << " to " << m_energies.back() << " MeV";
+      throw std::runtime_error(message.str());
    }
+   m_firstInterval = energyInterval(m_emin);
+   m_lastInterval = energyInterval(m_emax);
 }
 
-double MapCube::powerLawIntegral(double x1, double x2,
-                                 double y1, double y2, double & gamma) const {
-   gamma = std::log(y2/y1)/std::log(x2/x1);
-   double n0 = y1/std::pow(x1, gamma);
-   double integral;
-   if (gamma != 1.) {
-      double gp1 = gamma + 1.;
-      integral = n0/gp1*(std::pow(x2, gp1) - std::pow(x1, gp1));
-   } else {
-      integral = n0*std::log(x2/x1);
+size_t MapCube::energyInterval(double energy) const {
+   int indx = std::upper_bound(m_energies.begin(), m_energies.end(), energy)
+      - m_energies.begin() - 1;
+   int nmax = m_energies.size() - 2;
+   return std::min(std::max(0, indx), nmax);
+}
+
+double MapCube::cumulativeCounts(const float * spectrum,
+                                 double energy) const {
+// Within an interval, the counts up to energy are the fraction
+// (e^{u'} - 1)/(e^u - 1) of those in the interval, where
+// u' = (gamma + 1)*log(energy/x1) and u = (gamma + 1)*log(x2/x1).
+   size_t nee(m_energies.size());
+   const float * counts = spectrum;
+   const float * gammas = spectrum + nee;
+   size_t k(energyInterval(energy));
+   double logRatio(std::log(m_energies[k+1]/m_energies[k]));
+   double logPartial(std::log(energy/m_energies[k]));
+   double gp1(gammas[k] + 1.);
+   double fraction(logPartial/logRatio);
+   if (gp1 != 0) {
+      fraction = std::expm1(gp1*logPartial)/std::expm1(gp1*logRatio);
    }
-   return integral;
+   return counts[k] + fraction*(counts[k+1] - counts[k]);
 }
 
-double MapCube::
-drawEnergy(const Spectrum_t & spectrum) const {
-   double xi = CLHEP::RandFlat::shoot()*spectrum.back().first;
-   Spectrum_t::const_iterator it 
-      = std::upper_bound(spectrum.begin(), spectrum.end(),
-                         std::make_pair(xi, 0), cmpPair);
-   int indx = it - spectrum.begin() - 1;
-   int nmax = spectrum.size() - 2;
-   indx = std::min(std::max(0, indx), nmax);
+double MapCube::drawEnergy(const float * spectrum) const {
+   size_t nee(m_energies.size());
+   const float * counts = spectrum;
+   const float * gammas = spectrum + nee;
+   double emin(m_energies.front());
+   double emax(m_energies.back());
+   double cmin(0);
+   double cmax(counts[nee - 1]);
+   if (m_emax > 0) {
+      emin = m_emin;
+      emax = m_emax;
+      cmin = cumulativeCounts(spectrum, emin);
+      cmax = cumulativeCounts(spectrum, emax);
+   }
+   float xi = cmin + CLHEP::RandFlat::shoot()*(cmax - cmin);
+   int indx = std::upper_bound(counts, counts + nee, xi) - counts - 1;
+   int nmin = m_firstInterval;
+   int nmax = m_lastInterval;
+   indx = std::min(std::max(nmin, indx), nmax);
    double value 
-      = genericSources::Util::drawFromPowerLaw(m_energies.at(indx),
-                                               m_energies.at(indx+1),
-                                               -spectrum.at(indx+1).second);
+      = genericSources::Util::drawFromPowerLaw(std::max(m_energies.at(indx),
+                                                        emin),
+                                               std::min(m_energies.at(indx+1),
+                                                        emax),
+                                               -gammas[indx]);
    return value;
 }
-
-bool MapCube::cmpPair(const SpectralPoint_t & x, 
-                      const SpectralPoint_t & y) {
-   return x.first < y.first;
-}
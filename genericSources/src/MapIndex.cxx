@@ -0,0 +1,207 @@
+/**
+ * @file MapIndex.cxx
+ * @brief Binary file holding the ready-to-sample tables of a map-based
+ * source.
+ *
+ * $Header$
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "facilities/commonUtilities.h"
+
+#include "MapIndex.h"
+
+namespace {
+/// Layout of an index file: this header, the sizes in bytes of the
+/// nsections sections as 64-bit integers, then the sections, each
+/// padded to a multiple of 8 bytes.
+   struct FileHeader {
+      char magic[8];
+      unsigned int byteOrder;
+      unsigned int nsections;
+   };
+   const char s_magic[8] = {'M', 'A', 'P', 'I', 'D', 'X', '0', '1'};
+   const unsigned int s_byteOrder(0x01020304);
+
+   size_t padded(size_t nbytes) {
+      return (nbytes + 7)/8*8;
+   }
+
+/// 64-bit FNV-1a hash, used to name the index files.
+   unsigned long long fnv1a(const std::string & text) {
+      unsigned long long hash(14695981039346656037ULL);
+      for (size_t i = 0; i < text.size(); i++) {
+         hash ^= static_cast<unsigned char>(text[i]);
+         hash *= 1099511628211ULL;
+      }
+      return hash;
+   }
+}
+
+namespace genericSources {
+
+MapIndex::MapIndex(const std::string & indexFile, const std::string & key)
+   : m_map(0), m_mapSize(0) {
+   std::ifstream input(indexFile.c_str(), std::ios::binary);
+   if (!input) {
+      return;
+   }
+   input.seekg(0, std::ios::end);
+   std::streamoff size(input.tellg());
+   if (size < static_cast<std::streamoff>(sizeof(FileHeader))) {
+      return;
+   }
+#ifndef WIN32
+   input.close();
+   int fd(open(indexFile.c_str(), O_RDONLY));
+   if (fd < 0) {
+      return;
+   }
+   void * map(mmap(0, size, PROT_READ, MAP_SHARED, fd, 0));
+   close(fd);
+   if (map == MAP_FAILED) {
+      return;
+   }
+   m_map = map;
+   m_mapSize = size;
+   readSections(static_cast<const char *>(map), size, key);
+#else
+   m_data.resize(padded(size)/sizeof(double));
+   input.seekg(0, std::ios::beg);
+   input.read(reinterpret_cast<char *>(&m_data[0]), size);
+   if (!input) {
+      return;
+   }
+   readSections(reinterpret_cast<const char *>(&m_data[0]), size, key);
+#endif
+}
+
+MapIndex::~MapIndex() {
+#ifndef WIN32
+   if (m_map) {
+      munmap(m_map, m_mapSize);
+   }
+#endif
+}
+
+bool MapIndex::readSections(const char * data, size_t size,
+                            const std::string & key) {
+   FileHeader header;
+   std::memcpy(&header, data, sizeof(header));
+   if (std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0
+       || header.byteOrder != s_byteOrder || header.nsections == 0) {
+      return false;
+   }
+   size_t offset(sizeof(header) + header.nsections*sizeof(unsigned long long));
+   if (offset > size) {
+      return false;
+   }
+   const unsigned long long * sizes
+      = reinterpret_cast<const unsigned long long *>(data + sizeof(header));
+   std::vector< std::pair<const char *, size_t> > sections;
+   for (size_t i = 0; i < header.nsections; i++) {
+      if (sizes[i] > size - offset) {
+         return false;
+      }
+      sections.push_back(std::make_pair(data + offset, size_t(sizes[i])));
+      offset += padded(sizes[i]);
+// The padding of a truncated file may run past its end, which would
+// make size - offset wrap around for the next section.
+      if (offset > size) {
+         return false;
+      }
+   }
+   if (std::string(sections[0].first, sections[0].second) != key) {
+      return false;
+   }
+   m_sections.swap(sections);
+   return true;
+}
+
+void MapIndex::write(const std::string & indexFile, const std::string & key,
+                     const std::vector<Section> & sections) {
+   std::vector<Section> all;
+   all.push_back(Section(key.data(), key.size()));
+   all.insert(all.end(), sections.begin(), sections.end());
+
+   FileHeader header;
+   std::memcpy(header.magic, s_magic, sizeof(s_magic));
+   header.byteOrder = s_byteOrder;
+   header.nsections = all.size();
+   std::vector<unsigned long long> sizes;
+   for (size_t i = 0; i < all.size(); i++) {
+      sizes.push_back(all[i].second);
+   }
+
+   std::ostringstream tmpFile;
+   tmpFile << indexFile << ".tmp";
+#ifndef WIN32
+   tmpFile << getpid();
+#endif
+   std::ofstream output(tmpFile.str().c_str(), std::ios::binary);
+   if (!output) {
+      return;
+   }
+   output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+   output.write(reinterpret_cast<const char *>(&sizes[0]),
+                sizes.size()*sizeof(unsigned long long));
+   const char padding[8] = {0};
+   for (size_t i = 0; i < all.size(); i++) {
+      if (all[i].second > 0) {
+         output.write(static_cast<const char *>(all[i].first), all[i].second);
+      }
+      output.write(padding, padded(all[i].second) - all[i].second);
+   }
+   output.close();
+   if (!output || std::rename(tmpFile.str().c_str(), indexFile.c_str()) != 0) {
+      std::remove(tmpFile.str().c_str());
+   }
+}
+
+std::string MapIndex::key(const std::string & fitsFile,
+                          const std::string & options) {
+   struct stat info;
+   if (stat(fitsFile.c_str(), &info) != 0) {
+      return "";
+   }
+   std::string path(fitsFile);
+#ifndef WIN32
+   char * resolved(realpath(fitsFile.c_str(), 0));
+   if (resolved != 0) {
+      path = resolved;
+      std::free(resolved);
+   }
+#endif
+   std::ostringstream key;
+   key << path << "\n"
+       << static_cast<long long>(info.st_mtime) << " "
+       << static_cast<long long>(info.st_size) << "\n"
+       << options;
+   return key.str();
+}
+
+std::string MapIndex::indexFile(const std::string & key) {
+   const char * indexDir(std::getenv("GENERICSOURCES_MAP_INDEX"));
+   if (indexDir == 0 || std::string(indexDir) == "" || key == "") {
+      return "";
+   }
+   std::ostringstream basename;
+   basename << "mapIndex_" << std::hex << fnv1a(key) << ".bin";
+   return facilities::commonUtilities::joinPath(indexDir, basename.str());
+}
+
+} // namespace genericSources
@@ -0,0 +1,98 @@
+/**
+ * @file MapIndex.h
+ * @brief Binary file holding the ready-to-sample tables of a map-based
+ * source.
+ *
+ * $Header$
+ */
+
+#ifndef genericSources_MapIndex_h
+#define genericSources_MapIndex_h
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace genericSources {
+
+/**
+ * @class MapIndex
+ * @brief A file of 8-byte aligned sections in native byte order, used
+ * to save the sampling tables of a map-based source so that later
+ * constructions of the same source can use them without reading the
+ * FITS file or recomputing anything.  The file is mapped read-only, so
+ * processes using the same index share its pages.
+ *
+ * Index files are kept in the directory given by the
+ * GENERICSOURCES_MAP_INDEX environment variable; no index files are
+ * used if it is not set.  An index is found from a key comprising the
+ * path, modification time, and size of the FITS file, and the options
+ * that determine the tables; the key is stored in the first section
+ * and checked when the index is read.
+ */
+
+class MapIndex {
+
+public:
+
+   /// Map an existing index file.  The index is invalid if the file
+   /// does not exist or its first section does not match key.
+   MapIndex(const std::string & indexFile, const std::string & key);
+
+   ~MapIndex();
+
+   bool valid() const {
+      return !m_sections.empty();
+   }
+
+   size_t numSections() const {
+      return m_sections.size();
+   }
+
+   /// @return The contents of section i as an array of n elements.
+   template <typename T>
+   const T * section(size_t i, size_t & n) const {
+      n = m_sections.at(i).second/sizeof(T);
+      return reinterpret_cast<const T *>(m_sections.at(i).first);
+   }
+
+   /// A section to be written: its data and size in bytes.
+   typedef std::pair<const void *, size_t> Section;
+
+   /// Write an index file with the key as its first section, followed
+   /// by the given sections.  The file is written under a temporary
+   /// name and renamed, so that concurrent readers never see a partial
+   /// file.  Failing to write it is not an error.
+   static void write(const std::string & indexFile, const std::string & key,
+                     const std::vector<Section> & sections);
+
+   /// @return The key for the tables of a FITS file built with the
+   ///         given options, or "" if the file cannot be examined.
+   static std::string key(const std::string & fitsFile,
+                          const std::string & options);
+
+   /// @return The index file for a key, or "" if index files are not
+   ///         in use.
+   static std::string indexFile(const std::string & key);
+
+private:
+
+   void * m_map;
+   size_t m_mapSize;
+
+   /// File contents, if it was read rather than mapped.
+   std::vector<double> m_data;
+
+   std::vector< std::pair<const char *, size_t> > m_sections;
+
+   // Disable copying, since the object may own a mapping.
+   MapIndex(const MapIndex &);
+   MapIndex & operator=(const MapIndex &);
+
+   bool readSections(const char * data, size_t size, const std::string & key);
+
+};
+
+} // namespace genericSources
+
+#endif // genericSources_MapIndex_h
@@ -8,8 +8,11 @@
 
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 
 #include <algorithm>
+#include <memory>
+#include <sstream>
 #include <stdexcept>
 
 #include "CLHEP/Random/RandomEngine.h"
@@ -24,7 +27,12 @@
 #include "flux/SpectrumFactory.h"
 #include "flux/EventSource.h"
 
+#include "AliasTable.h"
 #include "FitsImage.h"
+#include "HealpixImage.h"
+#include "MapIndex.h"
+#include "Parallel.h"
+#include "SkyRegion.h"
 #include "Util.h"
 
 #include "genericSources/MapSource.h"
@@ -36,8 +44,19 @@ ISpectrumFactory & MapSourceFactory() {
    return myFactory;
 }
 
+namespace {
+/// Pixels per block of the cumulative distribution, and the fewest
+/// blocks worth a thread of their own.
+   const size_t s_sumBlock(4096);
+   const size_t s_minBlocks(16);
+}
+
 MapSource::MapSource(const std::string & paramString) 
-   : m_flux(1.), m_gamma(2), m_emin(30.), m_emax(1e5) {
+   : m_flux(1.), m_gamma(2), m_emin(30.), m_emax(1e5),
+     m_nside(0), m_nested(false), m_pixelSampler(SEARCH), m_index(0),
+     m_integralValues(0), m_aliasEntries(0), m_tileValues(0),
+     m_weightValues(0), m_npix(0), m_ntiles(0), m_fluxScale(1),
+     m_region(0) {
    
    std::string fitsFile;
    bool createSubMap(false);
@@ -91,6 +110,10 @@ MapSource::MapSource(const std::string & paramString)
          m_emax = parmap.value("emax");
       } catch (...) {
       }
+      if (parmap.find("pixelSampler") != parmap.end()) {
+         setPixelSampler(parmap["pixelSampler"]);
+      }
+      setRegion(parmap);
       //these 4 should be all absent or all present. Code is incorrect as is
       if (parmap.find("lonMin") != parmap.end() ||
           parmap.find("lonMax") != parmap.end() ||
@@ -119,13 +142,28 @@ MapSource::MapSource(const std::string & paramString)
 //              << m_latMax 
 //              << std::endl;
 
-   readFitsFile(fitsFile, createSubMap);
-   makeIntegralDistribution(m_image);
+   facilities::Util::expandEnvVar(&fitsFile);
+   std::string key(indexKey(fitsFile, "MapSource", createSubMap));
+   if (!loadIndex(key)) {
+      readFitsFile(fitsFile, createSubMap);
+      makeIntegralDistribution(m_image);
+      releasePixelArrays();
+      saveIndex(key);
+   }
 
 //    std::cerr << "Integral over the map: " 
 //              << m_mapIntegral << std::endl;
 }
 
+MapSource::~MapSource() {
+   delete m_index;
+   delete m_region;
+}
+
+const size_t MapSource::s_indexSections(7);
+
+const size_t MapSource::s_tileSize(256);
+
 float MapSource::operator()(float xi) const {
    double one_m_gamma = 1. - m_gamma;
    double arg = xi*(pow(m_emax, one_m_gamma) - pow(m_emin, one_m_gamma)) 
@@ -159,9 +197,7 @@ std::pair<double, double> MapSource::dir(double energy) {
    (void)(energy);
 
    double xi = CLHEP::RandFlat::shoot();
-   std::vector<double>::const_iterator it 
-      = std::upper_bound(m_integralDist.begin(), m_integralDist.end(), xi);
-   unsigned int indx = it - m_integralDist.begin();
+   unsigned int indx = drawPixel(xi);
 
    double lon, lat;
    samplePixel(indx, lon, lat);
@@ -174,9 +210,58 @@ std::pair<double, double> MapSource::dir(double energy) {
    return std::make_pair(lon, lat);
 }
 
+void MapSource::setPixelSampler(const std::string & sampler) {
+   if (sampler == "alias") {
+      m_pixelSampler = ALIAS;
+   } else if (sampler == "search") {
+      m_pixelSampler = SEARCH;
+   } else if (sampler == "tiles") {
+      m_pixelSampler = TILES;
+   } else {
+      throw std::runtime_error("MapSource: unknown pixelSampler " + sampler
+                               + "\nValid choices are search, alias "
+                               + "and tiles.");
+   }
+}
+
+unsigned int MapSource::drawPixel(double xi) const {
+   if (m_pixelSampler == SEARCH) {
+      return std::upper_bound(m_integralValues, m_integralValues + m_npix, xi)
+         - m_integralValues;
+   }
+   if (m_pixelSampler == TILES) {
+// xi picks the tile and a second deviate the pixel within it.
+      size_t tile(std::upper_bound(m_tileValues, m_tileValues + m_ntiles, xi)
+                  - m_tileValues);
+      tile = std::min(tile, m_ntiles - 1);
+      return tilePixel(tile, CLHEP::RandFlat::shoot());
+   }
+// xi picks the column; a second deviate decides between the column's
+// pixels, since xi may only have float precision.
+   size_t column(std::min(static_cast<size_t>(xi*m_npix), m_npix - 1));
+   const AliasEntry & entry(m_aliasEntries[column]);
+   if (CLHEP::RandFlat::shoot() < entry.prob) {
+      return column;
+   }
+   return entry.alias;
+}
+
 void MapSource::
 samplePixel(unsigned int indx, double &lon, double &lat) const {
+   if (m_nside > 0) {
+// HEALPix pixels are squares in an equal-area projection, so sampling
+// uniformly in the square samples uniformly in solid angle.
+      double x = CLHEP::RandFlat::shoot();
+      double y = CLHEP::RandFlat::shoot();
+      long long pixel(m_pixels.empty() ? indx : m_pixels[indx]);
+      genericSources::HealpixImage::pixelDirection(m_nside, m_nested, pixel,
+                                                   x, y, lon, lat);
+      return;
+   }
 
+   if (!m_pixels.empty()) {
+      indx = m_pixels[indx];
+   }
    unsigned int i = indx % m_lon.size();
    unsigned int j = indx/m_lon.size();
 
@@ -213,6 +298,11 @@ void MapSource::readFitsFile(std::string fitsFile, bool createSubMap) {
    facilities::Util::expandEnvVar(&fitsFile);
 
    genericSources::Util::file_ok(fitsFile);
+   if (genericSources::HealpixImage::isHealpix(fitsFile)) {
+      readHealpixFile(fitsFile, createSubMap);
+      applyRegion();
+      return;
+   }
    genericSources::FitsImage fitsImage(fitsFile);
    
    m_mapIntegral = fitsImage.mapIntegral();
@@ -224,7 +314,8 @@ void MapSource::readFitsFile(std::string fitsFile, bool createSubMap) {
 
       // rescale the flux by the sub-map integral
       double new_integral = fitsImage.mapIntegral();
-      m_flux *= new_integral/m_mapIntegral;
+      m_fluxScale = new_integral/m_mapIntegral;
+      m_flux *= m_fluxScale;
       m_mapIntegral = new_integral;
    } else {
       fitsImage.getAxisVector(0, m_lon);
@@ -232,10 +323,134 @@ void MapSource::readFitsFile(std::string fitsFile, bool createSubMap) {
    }
 
    fitsImage.getAxisNames(m_axisTypes);
-   fitsImage.getCelestialArrays(m_lonArray, m_latArray);
-
    fitsImage.getSolidAngles(m_solidAngles);
-   fitsImage.getImageData(m_image);
+   fitsImage.takeImageData(m_image);
+   applyRegion();
+}
+
+void MapSource::readHealpixFile(const std::string & fitsFile,
+                                bool createSubMap) {
+   genericSources::HealpixImage healpixImage(fitsFile);
+
+   m_mapIntegral = healpixImage.mapIntegral();
+
+   if (createSubMap) {
+      healpixImage.selectPixels(m_lonMin, m_lonMax, m_latMin, m_latMax);
+
+      // rescale the flux by the sub-map integral
+      double new_integral = healpixImage.mapIntegral();
+      m_fluxScale = new_integral/m_mapIntegral;
+      m_flux *= m_fluxScale;
+      m_mapIntegral = new_integral;
+   }
+
+   m_nside = healpixImage.nside();
+   m_nested = healpixImage.nested();
+   m_pixels = healpixImage.pixels();
+   m_lon.clear();
+   m_lat.clear();
+   m_axisTypes.clear();
+   if (healpixImage.coordSys() == astro::SkyDir::EQUATORIAL) {
+      m_axisTypes.push_back("RA");
+      m_axisTypes.push_back("DEC");
+   } else {
+      m_axisTypes.push_back("GLON");
+      m_axisTypes.push_back("GLAT");
+   }
+   healpixImage.getSolidAngles(m_solidAngles);
+   healpixImage.takeImageData(m_image);
+}
+
+void MapSource::setRegion(celestialSources::ConstParMap & parmap) {
+   if (parmap.find("roiCone") == parmap.end()
+       && parmap.find("roiPolygon") == parmap.end()) {
+      return;
+   }
+   astro::SkyDir::CoordSystem frame(astro::SkyDir::EQUATORIAL);
+   if (parmap.find("roiFrame") != parmap.end()) {
+      std::string name(parmap["roiFrame"]);
+      if (name == "galactic") {
+         frame = astro::SkyDir::GALACTIC;
+      } else if (name != "equatorial") {
+         throw std::runtime_error("MapSource: unknown roiFrame " + name
+                                  + "\nValid choices are equatorial "
+                                  + "and galactic.");
+      }
+   }
+   std::unique_ptr<genericSources::SkyRegion>
+      region(new genericSources::SkyRegion(frame));
+   if (parmap.find("roiCone") != parmap.end()) {
+      std::vector<double> cone
+         = genericSources::SkyRegion::parseList(parmap["roiCone"]);
+      if (cone.size() != 3) {
+         throw std::runtime_error("MapSource: roiCone must be given as "
+                                  "lon:lat:radius");
+      }
+      region->setCone(cone[0], cone[1], cone[2]);
+   }
+   if (parmap.find("roiPolygon") != parmap.end()) {
+      region->setPolygon(genericSources::SkyRegion::
+                         parseList(parmap["roiPolygon"]));
+   }
+   m_region = region.release();
+}
+
+void MapSource::applyRegion() {
+   if (m_region == 0) {
+      return;
+   }
+   m_region->setCoordSys(m_axisTypes[0].find_first_of("R") == 0 ?
+                         astro::SkyDir::EQUATORIAL : astro::SkyDir::GALACTIC);
+   size_t npix(m_solidAngles.size());
+   std::vector<size_t> kept;
+   for (size_t indx = 0; indx < npix; indx++) {
+      double lon, lat;
+      pixelCentre(indx, lon, lat);
+      if (m_region->contains(lon, lat)) {
+         kept.push_back(indx);
+      }
+   }
+   if (kept.empty()) {
+      throw std::runtime_error("MapSource: there are no map pixels within "
+                               "the region of interest");
+   }
+   size_t nplanes(m_image.size()/npix);
+   std::vector<double> image(nplanes*kept.size());
+   std::vector<double> solidAngles(kept.size());
+   std::vector<long long> pixels(kept.size());
+   for (size_t i = 0; i < kept.size(); i++) {
+      solidAngles[i] = m_solidAngles[kept[i]];
+      pixels[i] = m_pixels.empty() ? kept[i] : m_pixels[kept[i]];
+      for (size_t k = 0; k < nplanes; k++) {
+         image[k*kept.size() + i] = m_image[k*npix + kept[i]];
+      }
+   }
+   m_image.swap(image);
+   m_solidAngles.swap(solidAngles);
+   m_pixels.swap(pixels);
+
+   // rescale the flux by the integral over the region, which includes
+   // all of the kept pixels
+   double new_integral(0);
+   for (size_t i = firstPixel(); i < kept.size(); i++) {
+      new_integral += m_solidAngles[i]*m_image[i];
+   }
+   double scale(new_integral/m_mapIntegral);
+   m_fluxScale *= scale;
+   m_flux *= scale;
+   m_mapIntegral = new_integral;
+}
+
+void MapSource::pixelCentre(unsigned int indx, double & lon,
+                            double & lat) const {
+   long long pixel(m_pixels.empty() ? indx : m_pixels[indx]);
+   if (m_nside > 0) {
+      genericSources::HealpixImage::pixelDirection(m_nside, m_nested, pixel,
+                                                   0.5, 0.5, lon, lat);
+      return;
+   }
+   lon = m_lon.at(pixel % m_lon.size());
+   lat = m_lat.at(pixel/m_lon.size());
 }
 
 void MapSource::getSubMapAxes(const genericSources::FitsImage & fitsImage) {
@@ -303,18 +518,267 @@ makeIntegralDistribution(const std::vector<double> & pixelValues) {
                                + std::string("pixelValues vector has fewer ")
                                + "elements than the number of image pixels");
    }
+   if (m_pixelSampler == TILES) {
+      makeTiles(pixelValues);
+      std::vector<double>().swap(m_integralDist);
+      m_npix = npix;
+      return;
+   }
+   std::vector<double> weights(npix, 0);
+   for (unsigned int i = firstPixel(); i < npix; i++) {
+      weights[i] = m_solidAngles[i]*pixelValues[i];
+   }
+   if (m_pixelSampler == ALIAS) {
+      m_mapIntegral = genericSources::makeAliasTable(weights, m_aliasTable);
+      std::vector<double>().swap(m_integralDist);
+      m_aliasEntries = &m_aliasTable[0];
+      m_npix = npix;
+      return;
+   }
+// Prefix sum over fixed-size blocks: the partial sums within each block
+// are formed in parallel, the block totals are accumulated serially,
+// and the offsets are added and the sums normalized in parallel.  The
+// blocks do not depend on the number of threads, so neither does the
+// rounding of the result.
    m_integralDist.resize(npix);
-   m_integralDist[0] = 0;
-   double totalSolidAngle(0);
-   for (unsigned int i = 1; i < npix; i++) {
-      m_integralDist[i] = m_integralDist[i-1] 
-         + m_solidAngles[i]*pixelValues[i];
-      totalSolidAngle += m_solidAngles[i];
-   }
-   m_mapIntegral = m_integralDist[npix-1];
-   for (unsigned int i = 1; i < npix; i++) {
-      m_integralDist[i] /= m_integralDist[npix-1];
-   }
-//    std::cerr << "total solid angle in map: " 
-//              << totalSolidAngle/M_PI << "*pi" << std::endl;
+   size_t nblocks((npix + s_sumBlock - 1)/s_sumBlock);
+   std::vector<double> offsets(nblocks + 1, 0);
+   genericSources::forEachChunk(nblocks, s_minBlocks,
+                                [&](size_t first, size_t last) {
+         for (size_t block = first; block < last; block++) {
+            size_t begin(block*s_sumBlock);
+            size_t end(std::min(size_t(npix), begin + s_sumBlock));
+            double sum(0);
+            for (size_t i = begin; i < end; i++) {
+               sum += weights[i];
+               m_integralDist[i] = sum;
+            }
+            offsets[block + 1] = sum;
+         }
+      });
+   for (size_t block = 0; block < nblocks; block++) {
+      offsets[block + 1] += offsets[block];
+   }
+   m_mapIntegral = offsets[nblocks];
+   genericSources::forEachChunk(nblocks, s_minBlocks,
+                                [&](size_t first, size_t last) {
+         for (size_t block = first; block < last; block++) {
+            size_t begin(block*s_sumBlock);
+            size_t end(std::min(size_t(npix), begin + s_sumBlock));
+            for (size_t i = begin; i < end; i++) {
+               m_integralDist[i] = (m_integralDist[i] + offsets[block])
+                  /m_mapIntegral;
+            }
+         }
+      });
+   m_integralValues = &m_integralDist[0];
+   m_npix = npix;
+}
+
+void MapSource::releasePixelArrays() {
+   std::vector<double>().swap(m_solidAngles);
+   std::vector<double>().swap(m_image);
+}
+
+void MapSource::makeTiles(const std::vector<double> & pixelValues) {
+// The pixel weights are the only per-pixel table kept, and are stored
+// as floats.  The tile totals are summed from the stored weights, as
+// they are when a pixel is drawn from a tile.
+   size_t npix(m_solidAngles.size());
+   size_t first(firstPixel());
+   m_pixelWeights.assign(npix, 0);
+   m_ntiles = (npix + s_tileSize - 1)/s_tileSize;
+   m_tileDist.assign(m_ntiles, 0);
+   genericSources::forEachChunk(m_ntiles, s_minBlocks,
+                                [&](size_t firstTile, size_t lastTile) {
+         for (size_t tile = firstTile; tile < lastTile; tile++) {
+            size_t begin(std::max(first, tile*s_tileSize));
+            size_t end(std::min(npix, tile*s_tileSize + s_tileSize));
+            double sum(0);
+            for (size_t i = begin; i < end; i++) {
+               m_pixelWeights[i] = m_solidAngles[i]*pixelValues[i];
+               sum += m_pixelWeights[i];
+            }
+            m_tileDist[tile] = sum;
+         }
+      });
+   for (size_t tile = 1; tile < m_ntiles; tile++) {
+      m_tileDist[tile] += m_tileDist[tile - 1];
+   }
+   m_mapIntegral = m_tileDist.back();
+   for (size_t tile = 0; tile < m_ntiles; tile++) {
+      m_tileDist[tile] /= m_mapIntegral;
+   }
+   m_tileValues = &m_tileDist[0];
+   m_weightValues = &m_pixelWeights[0];
+}
+
+unsigned int MapSource::tilePixel(size_t tile, double xi) const {
+// Two passes over the weights of the tile, one for its total and one
+// to find the pixel, rather than keeping a distribution for each tile.
+   size_t begin(tile*s_tileSize);
+   size_t end(std::min(m_npix, begin + s_tileSize));
+   double total(0);
+   for (size_t i = begin; i < end; i++) {
+      total += m_weightValues[i];
+   }
+   double value(xi*total);
+   double sum(0);
+   for (size_t i = begin; i < end; i++) {
+      sum += m_weightValues[i];
+      if (sum > value) {
+         return i;
+      }
+   }
+   return end - 1;
+}
+
+std::string MapSource::indexKey(const std::string & fitsFile,
+                                const std::string & kind,
+                                bool createSubMap) const {
+   std::ostringstream options;
+   options.precision(17);
+   const char * samplers[] = {"search", "alias", "tiles"};
+   options << kind << " pixelSampler=" << samplers[m_pixelSampler];
+   if (m_pixelSampler == TILES) {
+      options << " tileSize=" << s_tileSize;
+   }
+   if (createSubMap) {
+      options << " lonMin=" << m_lonMin << " lonMax=" << m_lonMax
+              << " latMin=" << m_latMin << " latMax=" << m_latMax;
+   }
+   if (m_region != 0) {
+      options << " roi=" << m_region->description();
+   }
+   return genericSources::MapIndex::key(fitsFile, options.str());
+}
+
+bool MapSource::loadIndex(const std::string & key, size_t nsections) {
+// Sections: the key, the scalars, the axis types separated by
+// newlines, the longitudes, the latitudes, the HEALPix pixel numbers,
+// and the sampling table.
+   std::string indexFile(genericSources::MapIndex::indexFile(key));
+   if (indexFile == "") {
+      return false;
+   }
+   genericSources::MapIndex * index
+      = new genericSources::MapIndex(indexFile, key);
+   size_t npix;
+   if (!index->valid() || index->numSections() != nsections
+       || !validIndex(*index, npix)) {
+      delete index;
+      return false;
+   }
+   size_t n;
+   const double * scalars = index->section<double>(1, n);
+   m_mapIntegral = scalars[0];
+   m_fluxScale = scalars[1];
+   m_flux *= m_fluxScale;
+   m_nside = static_cast<long>(scalars[2]);
+   m_nested = scalars[3] != 0;
+   const char * axisTypes = index->section<char>(2, n);
+   std::string types(axisTypes, n);
+   facilities::Util::stringTokenize(types, "\n", m_axisTypes);
+   const double * lon = index->section<double>(3, n);
+   m_lon.assign(lon, lon + n);
+   const double * lat = index->section<double>(4, n);
+   m_lat.assign(lat, lat + n);
+   const long long * pixels = index->section<long long>(5, n);
+   m_pixels.assign(pixels, pixels + n);
+   m_npix = npix;
+   if (m_pixelSampler == ALIAS) {
+      m_aliasEntries = index->section<AliasEntry>(6, n);
+   } else if (m_pixelSampler == TILES) {
+// The number of pixels, the tile distribution and the pixel weights.
+      const double * tiles = index->section<double>(6, n);
+      m_ntiles = (m_npix + s_tileSize - 1)/s_tileSize;
+      m_tileValues = tiles + 1;
+      m_weightValues = reinterpret_cast<const float *>(m_tileValues
+                                                       + m_ntiles);
+   } else {
+      m_integralValues = index->section<double>(6, n);
+   }
+   m_index = index;
+   return true;
+}
+
+bool MapSource::validIndex(const genericSources::MapIndex & index,
+                           size_t & npix) const {
+   size_t n;
+   index.section<double>(1, n);
+   if (n < 4) {
+      return false;
+   }
+   const double * scalars = index.section<double>(1, n);
+   long nside(static_cast<long>(scalars[2]));
+   index.section<char>(2, n);
+   if (n == 0) {
+      return false;
+   }
+   size_t nlon, nlat, npixels;
+   index.section<double>(3, nlon);
+   index.section<double>(4, nlat);
+   index.section<long long>(5, npixels);
+// The pixels of the sampling table: those listed, or else all the
+// pixels of the HEALPix map or of the image.
+   if (npixels > 0) {
+      npix = npixels;
+   } else if (nside > 0) {
+      npix = 12*size_t(nside)*size_t(nside);
+   } else {
+      npix = nlon*nlat;
+   }
+   if (npix == 0) {
+      return false;
+   }
+   size_t nbytes;
+   const char * table = index.section<char>(6, nbytes);
+   if (m_pixelSampler == ALIAS) {
+      return nbytes == npix*sizeof(AliasEntry);
+   }
+   if (m_pixelSampler == TILES) {
+// The number of pixels, the tile distribution and the pixel weights.
+      size_t ntiles((npix + s_tileSize - 1)/s_tileSize);
+      return nbytes == (1 + ntiles)*sizeof(double) + npix*sizeof(float)
+         && *reinterpret_cast<const double *>(table) == double(npix);
+   }
+   return nbytes == npix*sizeof(double);
+}
+
+void MapSource::saveIndex(const std::string & key,
+                          const std::vector<IndexSection> & sections) const {
+   std::string indexFile(genericSources::MapIndex::indexFile(key));
+   if (indexFile == "") {
+      return;
+   }
+   double scalars[] = {m_mapIntegral, m_fluxScale, double(m_nside),
+                       double(m_nested)};
+   std::string axisTypes;
+   for (size_t i = 0; i < m_axisTypes.size(); i++) {
+      axisTypes += m_axisTypes[i] + "\n";
+   }
+   std::vector<IndexSection> all;
+   all.push_back(IndexSection(scalars, sizeof(scalars)));
+   all.push_back(IndexSection(axisTypes.data(), axisTypes.size()));
+   all.push_back(IndexSection(m_lon.data(), m_lon.size()*sizeof(double)));
+   all.push_back(IndexSection(m_lat.data(), m_lat.size()*sizeof(double)));
+   all.push_back(IndexSection(m_pixels.data(),
+                              m_pixels.size()*sizeof(long long)));
+   std::vector<char> tiles;
+   if (m_pixelSampler == ALIAS) {
+      all.push_back(IndexSection(m_aliasEntries, m_npix*sizeof(AliasEntry)));
+   } else if (m_pixelSampler == TILES) {
+      double npix(m_npix);
+      size_t tileBytes(m_ntiles*sizeof(double));
+      tiles.resize(sizeof(double) + tileBytes + m_npix*sizeof(float));
+      std::memcpy(&tiles[0], &npix, sizeof(double));
+      std::memcpy(&tiles[sizeof(double)], m_tileValues, tileBytes);
+      std::memcpy(&tiles[sizeof(double) + tileBytes], m_weightValues,
+                  m_npix*sizeof(float));
+      all.push_back(IndexSection(tiles.data(), tiles.size()));
+   } else {
+      all.push_back(IndexSection(m_integralValues, m_npix*sizeof(double)));
+   }
+   all.insert(all.end(), sections.begin(), sections.end());
+   genericSources::MapIndex::write(indexFile, key, all);
 }
@@ -0,0 +1,58 @@
+/**
+ * @file Parallel.h
+ * @brief Split loops over independent items across threads.
+ *
+ * $Header$
+ */
+
+#ifndef genericSources_Parallel_h
+#define genericSources_Parallel_h
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace genericSources {
+
+/**
+ * Apply task(begin, end) to contiguous chunks of [0, n), one chunk per
+ * core, but with at least minChunk items per chunk.  The task must only
+ * write to the items of its own chunk.  An exception thrown by any of
+ * the chunks is rethrown here once all of them have finished.
+ */
+template <typename Task>
+void forEachChunk(size_t n, size_t minChunk, const Task & task) {
+   size_t nthreads(std::thread::hardware_concurrency());
+   nthreads = std::max(size_t(1), std::min(nthreads, n/minChunk));
+   if (nthreads == 1) {
+      task(0, n);
+      return;
+   }
+   size_t chunk((n + nthreads - 1)/nthreads);
+   std::vector<std::exception_ptr> errors(nthreads);
+   std::vector<std::thread> threads;
+   for (size_t i = 0; i < nthreads; i++) {
+      size_t begin(std::min(n, i*chunk));
+      size_t end(std::min(n, begin + chunk));
+      threads.push_back(std::thread([&task, &errors, i, begin, end]() {
+               try {
+                  task(begin, end);
+               } catch (...) {
+                  errors[i] = std::current_exception();
+               }
+            }));
+   }
+   for (size_t i = 0; i < nthreads; i++) {
+      threads[i].join();
+   }
+   for (size_t i = 0; i < nthreads; i++) {
+      if (errors[i]) {
+         std::rethrow_exception(errors[i]);
+      }
+   }
+}
+
+} // namespace genericSources
+
+#endif // genericSources_Parallel_h
@@ -0,0 +1,157 @@
+/**
+ * @file SkyRegion.cxx
+ * @brief Region of interest, a cone and/or a polygon, used to select
+ * the pixels of a map.
+ *
+ * $Header$
+ */
+
+#include <cmath>
+#include <cstdlib>
+
+#include <sstream>
+#include <stdexcept>
+
+#include "facilities/Util.h"
+
+#include "SkyRegion.h"
+
+namespace genericSources {
+
+SkyRegion::SkyRegion(astro::SkyDir::CoordSystem frame)
+   : m_frame(frame), m_coneLon(0), m_coneLat(0), m_coneRadius(0),
+     m_cosRadius(1) {
+   m_coneAxis.x = 0;
+   m_coneAxis.y = 0;
+   m_coneAxis.z = 1;
+   m_centre = m_coneAxis;
+}
+
+void SkyRegion::setCone(double lon, double lat, double radius) {
+   if (radius <= 0) {
+      throw std::runtime_error("SkyRegion: the cone radius must be positive");
+   }
+   m_coneLon = lon;
+   m_coneLat = lat;
+   m_coneRadius = radius;
+}
+
+void SkyRegion::setPolygon(const std::vector<double> & vertices) {
+   if (vertices.size() < 6 || vertices.size() % 2 != 0) {
+      throw std::runtime_error("SkyRegion: a polygon needs the longitudes "
+                               "and latitudes of at least three vertices");
+   }
+   m_vertices = vertices;
+}
+
+std::vector<double> SkyRegion::parseList(const std::string & values) {
+   std::vector<std::string> tokens;
+   facilities::Util::stringTokenize(values, ":", tokens);
+   std::vector<double> numbers;
+   for (size_t i = 0; i < tokens.size(); i++) {
+      numbers.push_back(std::atof(tokens[i].c_str()));
+   }
+   return numbers;
+}
+
+void SkyRegion::setCoordSys(astro::SkyDir::CoordSystem coordSys) {
+   if (m_coneRadius > 0) {
+      m_coneAxis = unitVector(m_coneLon, m_coneLat, coordSys);
+      m_cosRadius = std::cos(m_coneRadius*M_PI/180.);
+   }
+   m_corners.clear();
+   Vector sum = {0, 0, 0};
+   for (size_t i = 0; i < m_vertices.size(); i += 2) {
+      m_corners.push_back(unitVector(m_vertices[i], m_vertices[i + 1],
+                                     coordSys));
+      sum.x += m_corners.back().x;
+      sum.y += m_corners.back().y;
+      sum.z += m_corners.back().z;
+   }
+   if (!m_corners.empty()) {
+      double norm(std::sqrt(sum.x*sum.x + sum.y*sum.y + sum.z*sum.z));
+      if (norm < 1e-10) {
+         throw std::runtime_error("SkyRegion: the polygon vertices do not "
+                                  "lie within a hemisphere");
+      }
+      m_centre.x = sum.x/norm;
+      m_centre.y = sum.y/norm;
+      m_centre.z = sum.z/norm;
+   }
+}
+
+bool SkyRegion::contains(double lon, double lat) const {
+   Vector dir(unitVector(lon, lat));
+   if (m_coneRadius > 0 && (dir.x*m_coneAxis.x + dir.y*m_coneAxis.y
+                            + dir.z*m_coneAxis.z) < m_cosRadius) {
+      return false;
+   }
+   if (m_corners.empty()) {
+      return true;
+   }
+// The winding angle is the same about a direction and its antipode,
+// so first keep to the hemisphere holding the polygon.
+   if (dir.x*m_centre.x + dir.y*m_centre.y + dir.z*m_centre.z <= 0) {
+      return false;
+   }
+// Winding angle of the polygon about dir, summed over the edges: the
+// angle between the projections of the edge ends onto the plane
+// normal to dir.  This is +-2 pi inside the polygon and 0 outside.
+   double winding(0);
+   for (size_t i = 0; i < m_corners.size(); i++) {
+      const Vector & a(m_corners[i]);
+      const Vector & b(m_corners[(i + 1) % m_corners.size()]);
+      double adot(a.x*dir.x + a.y*dir.y + a.z*dir.z);
+      double bdot(b.x*dir.x + b.y*dir.y + b.z*dir.z);
+      Vector ap = {a.x - adot*dir.x, a.y - adot*dir.y, a.z - adot*dir.z};
+      Vector bp = {b.x - bdot*dir.x, b.y - bdot*dir.y, b.z - bdot*dir.z};
+      Vector cross = {ap.y*bp.z - ap.z*bp.y, ap.z*bp.x - ap.x*bp.z,
+                      ap.x*bp.y - ap.y*bp.x};
+      winding += std::atan2(cross.x*dir.x + cross.y*dir.y + cross.z*dir.z,
+                            ap.x*bp.x + ap.y*bp.y + ap.z*bp.z);
+   }
+   return std::fabs(winding) > M_PI;
+}
+
+std::string SkyRegion::description() const {
+   std::ostringstream description;
+   description.precision(17);
+   description << (m_frame == astro::SkyDir::GALACTIC ? "galactic"
+                   : "equatorial");
+   if (m_coneRadius > 0) {
+      description << " cone=" << m_coneLon << ":" << m_coneLat
+                  << ":" << m_coneRadius;
+   }
+   if (!m_vertices.empty()) {
+      description << " polygon=";
+      for (size_t i = 0; i < m_vertices.size(); i++) {
+         description << (i > 0 ? ":" : "") << m_vertices[i];
+      }
+   }
+   return description.str();
+}
+
+SkyRegion::Vector SkyRegion::
+unitVector(double lon, double lat, astro::SkyDir::CoordSystem coordSys) const {
+   if (coordSys != m_frame) {
+      astro::SkyDir dir(lon, lat, m_frame);
+      if (coordSys == astro::SkyDir::GALACTIC) {
+         lon = dir.l();
+         lat = dir.b();
+      } else {
+         lon = dir.ra();
+         lat = dir.dec();
+      }
+   }
+   return unitVector(lon, lat);
+}
+
+SkyRegion::Vector SkyRegion::unitVector(double lon, double lat) {
+   double phi(lon*M_PI/180.);
+   double theta(lat*M_PI/180.);
+   Vector dir = {std::cos(theta)*std::cos(phi), std::cos(theta)*std::sin(phi),
+                 std::sin(theta)};
+   return dir;
+}
+
+} // namespace genericSources
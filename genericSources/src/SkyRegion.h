@@ -0,0 +1,94 @@
+/**
+ * @file SkyRegion.h
+ * @brief Region of interest, a cone and/or a polygon, used to select
+ * the pixels of a map.
+ *
+ * $Header$
+ */
+
+#ifndef genericSources_SkyRegion_h
+#define genericSources_SkyRegion_h
+
+#include <string>
+#include <vector>
+
+#include "astro/SkyDir.h"
+
+namespace genericSources {
+
+/**
+ * @class SkyRegion
+ * @brief A cone, a spherical polygon, or their intersection, defined
+ * in Galactic or equatorial coordinates.  The polygon edges are great
+ * circle arcs; the polygon must be simple and lie within the
+ * hemisphere centred on the mean of its vertices, but need not be
+ * convex.
+ *
+ * Directions are tested in the coordinate system of the map, into
+ * which the cone centre and polygon vertices are converted once by
+ * setCoordSys.
+ */
+
+class SkyRegion {
+
+public:
+
+   SkyRegion(astro::SkyDir::CoordSystem frame=astro::SkyDir::EQUATORIAL);
+
+   /// @param radius Cone radius in degrees.
+   void setCone(double lon, double lat, double radius);
+
+   /// @param vertices Longitudes and latitudes of at least three
+   ///        vertices, in degrees, alternating.
+   void setPolygon(const std::vector<double> & vertices);
+
+   /// Parse a colon-separated list of numbers, e.g., "83.6:22.0:15".
+   static std::vector<double> parseList(const std::string & values);
+
+   bool empty() const {
+      return m_coneRadius <= 0 && m_vertices.empty();
+   }
+
+   /// Set the coordinate system of the directions passed to contains.
+   void setCoordSys(astro::SkyDir::CoordSystem coordSys);
+
+   /// @return true if the direction (degrees), in the coordinate system
+   ///         given to setCoordSys, lies within the region.
+   bool contains(double lon, double lat) const;
+
+   /// @return Description of the region, for use in index keys.
+   std::string description() const;
+
+private:
+
+   astro::SkyDir::CoordSystem m_frame;
+
+   double m_coneLon;
+   double m_coneLat;
+   double m_coneRadius;
+
+   std::vector<double> m_vertices;
+
+   /// The cone axis and polygon vertices as unit vectors in the
+   /// coordinate system of the map.
+   struct Vector {
+      double x, y, z;
+   };
+   Vector m_coneAxis;
+   double m_cosRadius;
+   std::vector<Vector> m_corners;
+
+   /// Mean direction of the polygon vertices, which picks the
+   /// hemisphere holding the polygon.
+   Vector m_centre;
+
+   Vector unitVector(double lon, double lat,
+                     astro::SkyDir::CoordSystem coordSys) const;
+
+   static Vector unitVector(double lon, double lat);
+
+};
+
+} // namespace genericSources
+
+#endif // genericSources_SkyRegion_h
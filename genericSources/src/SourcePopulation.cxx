@@ -8,10 +8,13 @@
 
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 
 #include "CLHEP/Random/RandomEngine.h"
 #include "CLHEP/Random/JamesRandom.h"
@@ -20,6 +23,9 @@
 
 #include "facilities/Util.h"
 
+#include "tip/IFileSvc.h"
+#include "tip/Table.h"
+
 #include "astro/SkyDir.h"
 
 #include "flux/EventSource.h"
@@ -31,50 +37,54 @@
 
 #include "genericSources/SourcePopulation.h"
 
+#include "AliasTable.h"
 #include "Util.h"
 #include "GaussianQuadrature.h"
+#include "Parallel.h"
 
 namespace {
-   void cleanLine(std::string & line) {
-      char CR[1];
-      CR[0] = 0x0d;
-      if (line.find(CR) != std::string::npos) {
-         std::vector<std::string> tokens;
-         facilities::Util::stringTokenize(line, CR, tokens);
-         line = tokens.front();
-      }
+   struct BinaryHeader {
+      char magic[8];
+      unsigned int byteOrder;
+      unsigned int nsrcs;
+   };
+   const char s_magic[8] = {'S', 'R', 'C', 'P', 'O', 'P', '0', '1'};
+   const unsigned int s_byteOrder(0x01020304);
+
+   const char s_delimiters[] = ", \t\n";
+
+/// Fewest catalog entries worth handing to a thread of their own.
+   const size_t s_minChunk(1000);
+
+   bool isDelimiter(char c) {
+      return std::strchr(s_delimiters, c) != 0 && c != '\0';
    }
-   
-   void readLines(std::string inputFile, 
-                  std::vector<std::string> & lines,
-                  const std::string & skip,
-                  bool cleanLines) {
-      facilities::Util::expandEnvVar(&inputFile);
-      std::ifstream file(inputFile.c_str());
-      lines.clear();
-      std::string line;
-      while (std::getline(file, line, '\n')) {
-         if (line != "" && line != " "             //skip (most) blank lines 
-             && line.find_first_of(skip) != 0) {   //and commented lines
-            if (cleanLines) {
-               cleanLine(line);
-            }
-            lines.push_back(line);
-         }
+
+   void readFile(const std::string & infile, std::string & buffer) {
+      std::ifstream input(infile.c_str(), std::ios::binary);
+      input.seekg(0, std::ios::end);
+      std::streamoff size(input.tellg());
+      input.seekg(0, std::ios::beg);
+      if (!input || size < 0) {
+         throw std::runtime_error("SourcePopulation: cannot read " + infile);
+      }
+      buffer.resize(size);
+      if (size > 0) {
+         input.read(&buffer[0], size);
+      }
+      if (!input) {
+         throw std::runtime_error("SourcePopulation: cannot read " + infile);
       }
    }
-
 }
 
-IRB::EblAtten * SourcePopulation::PointSource::s_tau(0);
-
 ISpectrumFactory & SourcePopulationFactory() {
    static SpectrumFactory<SourcePopulation> myFactory;
    return myFactory;
 }
 
 SourcePopulation::SourcePopulation(const std::string & params) 
-   : m_tau(0), m_idOffset(100000), m_l(0), m_b(0), m_name("") {
+   : m_tau(0), m_idOffset(100000), m_l(0), m_b(0), m_currentSource(0) {
    if (params.find("=") == std::string::npos) {
       std::vector<std::string> pars;
       facilities::Util::stringTokenize(params, ",", pars);
@@ -97,7 +107,6 @@ SourcePopulation::SourcePopulation(const std::string & params)
       } catch(std::runtime_error & ) {
       }
    }
-   m_flux = m_cumulativeFlux.back();
 }
 
 SourcePopulation::~SourcePopulation() {
@@ -108,50 +117,287 @@ void SourcePopulation::setEblAtten(const std::string & ebl_par) {
    IRB::EblModel eblModel =
       static_cast<IRB::EblModel>(std::atoi(ebl_par.c_str()));
    m_tau = new IRB::EblAtten(eblModel);
-   PointSource::setEblAtten(m_tau);
+   for (size_t i = 0; i < m_sources.size(); i++) {
+      m_sources[i].setEblAtten(m_tau);
+   }
 }
 
 void SourcePopulation::readSourceFile(std::string input_file) {
    facilities::Util::expandEnvVar(&input_file);
    genericSources::Util::file_ok(input_file);
-   std::vector<std::string> lines;
-   ::readLines(input_file, lines, "#", true);
 
+   std::vector<CatalogEntry> entries;
+   readCatalog(input_file, m_names, entries);
+   if (entries.empty()) {
+      throw std::runtime_error("SourcePopulation::readSourceFile:\n"
+                               "no sources found in " + input_file);
+   }
+   setupSources(entries);
+
+   std::vector<double> fluxes(entries.size());
+   for (size_t i = 0; i < entries.size(); i++) {
+      fluxes[i] = entries[i].flux;
+   }
+   m_flux = genericSources::makeAliasTable(fluxes, m_aliasTable);
+}
+
+void SourcePopulation::
+setupSources(const std::vector<CatalogEntry> & entries) {
+// Each chunk of sources is built in a vector of its own, since a
+// PointSource integrates its spectrum on construction and so cannot
+// be default-constructed and filled in place.  Neither the sky
+// coordinate conversion nor the quadrature keeps any shared state.
+   size_t nsrcs(entries.size());
+   m_ls.resize(nsrcs);
+   m_bs.resize(nsrcs);
+   size_t nchunks((nsrcs + s_minChunk - 1)/s_minChunk);
+   std::vector< std::vector<PointSource> > chunks(nchunks);
+   genericSources::forEachChunk(nchunks, 1, [&](size_t first, size_t last) {
+         for (size_t k = first; k < last; k++) {
+            size_t begin(k*s_minChunk);
+            size_t end(std::min(nsrcs, begin + s_minChunk));
+            chunks[k].reserve(end - begin);
+            for (size_t i = begin; i < end; i++) {
+               const CatalogEntry & entry(entries[i]);
+               astro::SkyDir dir(entry.ra, entry.dec);
+               m_ls[i] = dir.l();
+               m_bs[i] = dir.b();
+               chunks[k].push_back(PointSource(entry.gamma, entry.gamma2,
+                                               entry.ebreak, entry.emin,
+                                               entry.emax, entry.z));
+            }
+         }
+      });
    m_sources.clear();
-   m_sources.reserve(lines.size());
+   m_sources.reserve(nsrcs);
+   for (size_t k = 0; k < nchunks; k++) {
+      m_sources.insert(m_sources.end(), chunks[k].begin(), chunks[k].end());
+   }
+}
 
-   m_cumulativeFlux.clear();
-   m_cumulativeFlux.reserve(lines.size());
+void SourcePopulation::readCatalog(const std::string & input_file,
+                                   std::vector<std::string> & names,
+                                   std::vector<CatalogEntry> & entries) {
+   char magic[sizeof(s_magic)] = {0};
+   std::ifstream input(input_file.c_str(), std::ios::binary);
+   input.read(magic, sizeof(magic));
+   input.close();
+   if (std::memcmp(magic, s_magic, sizeof(s_magic)) == 0) {
+      readBinaryCatalog(input_file, names, entries);
+   } else if (std::strncmp(magic, "SIMPLE  ", sizeof(magic)) == 0) {
+      readFitsCatalog(input_file, names, entries);
+   } else {
+      readTextCatalog(input_file, names, entries);
+   }
+}
 
-   std::vector<std::string>::const_iterator line = lines.begin();
-   for ( ; line != lines.end(); ++line) {
-      m_sources.push_back(PointSource(*line));
-      if (line == lines.begin()) {
-         m_cumulativeFlux.push_back(m_sources.back().flux());
-      } else {
-         m_cumulativeFlux.push_back(m_cumulativeFlux.back() 
-                                    + m_sources.back().flux());
+void SourcePopulation::readTextCatalog(const std::string & input_file,
+                                       std::vector<std::string> & names,
+                                       std::vector<CatalogEntry> & entries) {
+   std::string buffer;
+   readFile(input_file, buffer);
+
+// Locate the catalog lines, skipping blank and commented lines.
+// Anything following a carriage return is ignored.
+   std::vector< std::pair<const char *, const char *> > lines;
+   const char * pos(buffer.data());
+   const char * bufferEnd(pos + buffer.size());
+   while (pos < bufferEnd) {
+      const char * eol = static_cast<const char *>
+         (std::memchr(pos, '\n', bufferEnd - pos));
+      if (eol == 0) {
+         eol = bufferEnd;
       }
+      const char * cr = static_cast<const char *>
+         (std::memchr(pos, '\r', eol - pos));
+      const char * last(cr != 0 ? cr : eol);
+      const char * first(pos);
+      while (first < last && isDelimiter(*first)) {
+         first++;
+      }
+      if (first < last && *pos != '#') {
+         lines.push_back(std::make_pair(first, last));
+      }
+      pos = eol + 1;
+   }
+
+// Tokenize and convert the lines in place.
+   names.resize(lines.size());
+   entries.resize(lines.size());
+   genericSources::forEachChunk(lines.size(), s_minChunk,
+                                [&](size_t begin, size_t end) {
+         const size_t nfields(10);
+         const char * tokens[nfields];
+         for (size_t i = begin; i < end; i++) {
+            const char * pos(lines[i].first);
+            const char * last(lines[i].second);
+            size_t ntokens(0);
+            size_t namelen(0);
+            while (pos < last) {
+               const char * token(pos);
+               while (pos < last && !isDelimiter(*pos)) {
+                  pos++;
+               }
+               if (ntokens == 0) {
+                  namelen = pos - token;
+               }
+               if (ntokens < nfields) {
+                  tokens[ntokens] = token;
+               }
+               ntokens++;
+               while (pos < last && isDelimiter(*pos)) {
+                  pos++;
+               }
+            }
+            if (ntokens < nfields - 1) {
+               throw std::runtime_error("SourcePopulation: too few fields "
+                                        "in catalog line\n"
+                                        + std::string(lines[i].first, last));
+            }
+            names[i].assign(tokens[0], namelen);
+            CatalogEntry & entry(entries[i]);
+            entry.ra = std::strtod(tokens[1], 0);
+            entry.dec = std::strtod(tokens[2], 0);
+            entry.flux = std::strtod(tokens[3], 0);
+            entry.gamma = std::strtod(tokens[4], 0);
+            entry.gamma2 = std::strtod(tokens[5], 0);
+            entry.ebreak = std::strtod(tokens[6], 0);
+            entry.emin = std::strtod(tokens[7], 0);
+            entry.emax = std::strtod(tokens[8], 0);
+            entry.z = ntokens == nfields ? std::strtod(tokens[9], 0) : 0;
+         }
+      });
+}
+
+void SourcePopulation::
+readBinaryCatalog(const std::string & input_file,
+                  std::vector<std::string> & names,
+                  std::vector<CatalogEntry> & entries) {
+   std::string buffer;
+   readFile(input_file, buffer);
+   BinaryHeader header;
+   if (buffer.size() < sizeof(header)) {
+      throw std::runtime_error("SourcePopulation: truncated binary catalog "
+                               + input_file);
+   }
+   std::memcpy(&header, buffer.data(), sizeof(header));
+   size_t size(sizeof(header) + size_t(header.nsrcs)*sizeof(CatalogEntry));
+   if (header.byteOrder != s_byteOrder) {
+      throw std::runtime_error("SourcePopulation: binary catalog " 
+                               + input_file + " has the wrong byte order");
+   }
+   if (buffer.size() < size) {
+      throw std::runtime_error("SourcePopulation: truncated binary catalog "
+                               + input_file);
+   }
+   entries.resize(header.nsrcs);
+   if (header.nsrcs > 0) {
+      std::memcpy(&entries[0], buffer.data() + sizeof(header),
+                  entries.size()*sizeof(CatalogEntry));
+   }
+// The names follow, each terminated by a null character.
+   names.resize(header.nsrcs);
+   const char * pos(buffer.data() + size);
+   const char * end(buffer.data() + buffer.size());
+   for (size_t i = 0; i < names.size(); i++) {
+      const char * null = static_cast<const char *>
+         (std::memchr(pos, '\0', end - pos));
+      if (null == 0) {
+         throw std::runtime_error("SourcePopulation: truncated binary "
+                                  "catalog " + input_file);
+      }
+      names[i].assign(pos, null);
+      pos = null + 1;
+   }
+}
+
+void SourcePopulation::readFitsCatalog(const std::string & input_file,
+                                       std::vector<std::string> & names,
+                                       std::vector<CatalogEntry> & entries) {
+   std::unique_ptr<const tip::Table> 
+      table(tip::IFileSvc::instance().readTable(input_file, "SOURCES"));
+   const tip::Table::FieldCont & fields(table->getValidFields());
+   bool haveRedshifts(std::find(fields.begin(), fields.end(), "z")
+                      != fields.end());
+   size_t nrows(table->getNumRecords());
+
+   names.resize(nrows);
+   entries.resize(nrows);
+
+   tip::Table::ConstIterator row(table->begin());
+   tip::ConstTableRecord & record(*row);
+   for (size_t i = 0; i < nrows; i++, ++row) {
+      CatalogEntry & entry(entries[i]);
+      record["name"].get(names[i]);
+      record["ra"].get(entry.ra);
+      record["dec"].get(entry.dec);
+      record["flux"].get(entry.flux);
+      record["gamma"].get(entry.gamma);
+      record["gamma2"].get(entry.gamma2);
+      record["ebreak"].get(entry.ebreak);
+      record["emin"].get(entry.emin);
+      record["emax"].get(entry.emax);
+      entry.z = 0;
+      if (haveRedshifts) {
+         record["z"].get(entry.z);
+      }
+   }
+}
+
+void SourcePopulation::writeBinaryCatalog(const std::string & infile,
+                                          const std::string & outfile) {
+   std::string input_file(infile);
+   facilities::Util::expandEnvVar(&input_file);
+   genericSources::Util::file_ok(input_file);
+   std::vector<std::string> names;
+   std::vector<CatalogEntry> entries;
+   readCatalog(input_file, names, entries);
+
+   std::ofstream output(outfile.c_str(), std::ios::binary);
+   if (!output) {
+      throw std::runtime_error("SourcePopulation::writeBinaryCatalog: "
+                               "cannot open " + outfile);
+   }
+   BinaryHeader header;
+   std::memcpy(header.magic, s_magic, sizeof(s_magic));
+   header.byteOrder = s_byteOrder;
+   header.nsrcs = entries.size();
+   output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+   if (!entries.empty()) {
+      output.write(reinterpret_cast<const char *>(&entries[0]),
+                   entries.size()*sizeof(CatalogEntry));
+   }
+   for (size_t i = 0; i < names.size(); i++) {
+      output.write(names[i].c_str(), names[i].size() + 1);
+   }
+   if (!output) {
+      throw std::runtime_error("SourcePopulation::writeBinaryCatalog: "
+                               "error writing " + outfile);
    }
 }
 
 float SourcePopulation::operator()(float xi) {
-   xi *= m_flux;
-   std::vector<double>::const_iterator it = 
-      std::upper_bound(m_cumulativeFlux.begin(), m_cumulativeFlux.end(), xi);
-   size_t indx = it - m_cumulativeFlux.begin();
-   m_currentEnergy = m_sources.at(indx).energy();
-   m_l = m_sources.at(indx).dir().l();
-   m_b = m_sources.at(indx).dir().b();
-   setIdentifier(indx + m_idOffset);
-   m_name = m_sources.at(indx).name();
-   return m_currentEnergy;
+// xi only has float precision, so it is used to pick the column of the
+// alias table and a second deviate decides between the column's sources.
+   size_t nsrcs(m_aliasTable.size());
+   size_t column(std::min(static_cast<size_t>(double(xi)*nsrcs), nsrcs - 1));
+   return drawPhoton(selectSource(column, CLHEP::RandFlat::shoot()));
 }
 
 double SourcePopulation::energy(double time) {
    (void)(time);
-   double xi = CLHEP::RandFlat::shoot();
-   return this->operator()(xi);
+   double xi = CLHEP::RandFlat::shoot()*m_aliasTable.size();
+   size_t column(std::min(static_cast<size_t>(xi), m_aliasTable.size() - 1));
+   return drawPhoton(selectSource(column, xi - column));
+}
+
+float SourcePopulation::drawPhoton(size_t indx) {
+   m_currentEnergy = m_sources[indx].energy();
+   m_l = m_ls[indx];
+   m_b = m_bs[indx];
+   setIdentifier(indx + m_idOffset);
+   m_currentSource = indx;
+   return m_currentEnergy;
 }
 
 double SourcePopulation::interval(double time) {
@@ -166,68 +412,233 @@ double SourcePopulation::interval(double time) {
 }
 
 std::string SourcePopulation::name() const {
-   return m_name;
+   if (m_sources.empty()) {
+      return "";
+   }
+   return m_names[m_currentSource];
 }
 
 //SourcePopulation::PointSource * SourcePopulation::PointSource::Self::s_self(0);
 
 SourcePopulation::
-PointSource::PointSource(const astro::SkyDir & dir, double flux,
-                         double gamma, double gamma2, double ebreak,
+PointSource::PointSource(double gamma, double gamma2, double ebreak,
                          double emin, double emax, double zz) 
-   : m_dir(dir), m_flux(flux), m_gamma(gamma), m_gamma2(gamma2),
-     m_ebreak(ebreak), m_emin(emin), m_emax(emax), m_z(zz) {
+   : m_gamma(gamma), m_gamma2(gamma2), m_ebreak(ebreak),
+     m_emin(emin), m_emax(emax), m_z(zz), m_tau(0), m_rejections(0) {
    setPowerLaw();
 }
 
-SourcePopulation::
-PointSource::PointSource(const std::string & line) : m_z(0) {
-   std::vector<std::string> tokens;
-   facilities::Util::stringTokenize(line, ", \t\n", tokens);
-   m_name = tokens.at(0);
-   double ra = std::atof(tokens.at(1).c_str());
-   double dec = std::atof(tokens.at(2).c_str());
-   m_dir = astro::SkyDir(ra, dec);
-   m_flux = std::atof(tokens.at(3).c_str());
-   m_gamma = std::atof(tokens.at(4).c_str());
-   m_gamma2 = std::atof(tokens.at(5).c_str());
-   m_ebreak = std::atof(tokens.at(6).c_str());
-   m_emin = std::atof(tokens.at(7).c_str());
-   m_emax = std::atof(tokens.at(8).c_str());
-   if (tokens.size() == 10) {
-      m_z = std::atof(tokens.at(9).c_str());
-   }
-   setPowerLaw();
-}
+const size_t SourcePopulation::PointSource::s_nodes(64);
+const size_t SourcePopulation::PointSource::s_maxNodes(1024);
+const double SourcePopulation::PointSource::s_tolerance(1e-3);
 
 void 
 SourcePopulation::
 PointSource::setPowerLaw() {
-   m_part1 = integral(m_emin, m_ebreak);
-   m_part2 = integral(m_ebreak, m_emax);
-   m_frac = m_part1/(m_part1 + m_part2);
+   double part1(integral(m_emin, m_ebreak));
+   double part2(integral(m_ebreak, m_emax));
+   m_frac = part1/(part1 + part2);
 }
 
 double SourcePopulation::
 PointSource::energy() const {
+   if (!m_table.empty()) {
+      return drawFromTable(CLHEP::RandFlat::shoot());
+   }
+// Draw from the unattenuated broken power-law and accept with
+// probability exp(-tau); a rejected draw starts over with the choice
+// of power-law segment.
    double my_energy;
+   unsigned int ntries(0);
+   do {
+      my_energy = drawUnattenuated();
+      ntries++;
+   } while (CLHEP::RandFlat::shoot() > attenuation(my_energy));
+   if (ntries > 1 && m_rejections < s_nodes) {
+      m_rejections += ntries - 1;
+      if (m_rejections >= s_nodes) {
+         makeTable();
+      }
+   }
+   return my_energy;
+}
+
+double SourcePopulation::
+PointSource::drawUnattenuated() const {
    double xi(CLHEP::RandFlat::shoot());
    if (xi < m_frac) {
-      do {
-         xi = CLHEP::RandFlat::shoot();
-         double aa(1. - m_gamma);
-         double bb(std::pow(m_ebreak, aa) - std::pow(m_emin, aa));
-         my_energy = std::pow(xi*bb + std::pow(m_emin, aa), 1./aa);
-      } while (CLHEP::RandFlat::shoot() > attenuation(my_energy));
-   } else {
-      do {
-         xi = CLHEP::RandFlat::shoot();
-         double aa(1. - m_gamma2);
-         double bb(std::pow(m_emax, aa) - std::pow(m_ebreak, aa));
-         my_energy = std::pow(xi*bb + std::pow(m_ebreak, aa), 1./aa);
-      } while (CLHEP::RandFlat::shoot() > attenuation(my_energy));
+      xi = CLHEP::RandFlat::shoot();
+      double aa(1. - m_gamma);
+      double bb(std::pow(m_ebreak, aa) - std::pow(m_emin, aa));
+      return std::pow(xi*bb + std::pow(m_emin, aa), 1./aa);
    }
-   return my_energy;
+   xi = CLHEP::RandFlat::shoot();
+   double aa(1. - m_gamma2);
+   double bb(std::pow(m_emax, aa) - std::pow(m_ebreak, aa));
+   return std::pow(xi*bb + std::pow(m_ebreak, aa), 1./aa);
+}
+
+void SourcePopulation::
+PointSource::makeTable() const {
+// If no table is made, rejection sampling goes on and is not retried.
+   m_rejections = s_nodes;
+
+// Start from nodes log-spaced from emin to emax, with the break moved
+// onto the nearest node so that each interval is a single power-law
+// times a smoothly varying attenuation.
+   size_t nn(s_nodes);
+   std::vector<float> energies(nn);
+   double logEmin(std::log(m_emin));
+   double dlogE(std::log(m_emax/m_emin)/(nn - 1));
+   for (size_t k = 0; k < nn; k++) {
+      energies[k] = std::exp(logEmin + k*dlogE);
+   }
+   if (m_ebreak > m_emin && m_ebreak < m_emax) {
+      size_t kb(static_cast<size_t>(std::log(m_ebreak/m_emin)/dlogE + 0.5));
+      kb = std::max(size_t(1), std::min(kb, nn - 2));
+      energies[kb] = m_ebreak;
+   }
+   energies.front() = m_emin;
+   energies.back() = m_emax;
+   std::vector<float> taus;
+   m_tau->operator()(energies, m_z, taus);
+
+   std::vector<double> energy(nn), dnde(nn);
+   for (size_t k = 0; k < nn; k++) {
+      energy[k] = k == 0 ? m_emin : (k == nn - 1 ? m_emax : energies[k]);
+      dnde[k] = attenuatedDnde(energy[k], taus[k]);
+   }
+
+// Refine.  The error of the integral over an interval is estimated as
+// the difference between the interpolated and the actual dN/dE at its
+// logarithmic midpoint, times the width of the interval; the same
+// midpoint rule estimates the total.  While the errors add up to more
+// than s_tolerance of the total, every interval with more than its
+// share of the tolerance is split at its midpoint.
+   std::vector<double> midEnergy(nn - 1), midDnde(nn - 1);
+   std::vector<char> evaluated(nn - 1, 0);
+   std::vector<double> errors;
+   while (true) {
+      energies.clear();
+      for (size_t k = 0; k < energy.size() - 1; k++) {
+         if (!evaluated[k]) {
+            midEnergy[k] = std::sqrt(energy[k]*energy[k+1]);
+            energies.push_back(midEnergy[k]);
+         }
+      }
+      m_tau->operator()(energies, m_z, taus);
+      size_t nmid(0);
+      double total(0), error(0);
+      errors.resize(energy.size() - 1);
+      for (size_t k = 0; k < energy.size() - 1; k++) {
+         if (!evaluated[k]) {
+            midDnde[k] = attenuatedDnde(midEnergy[k], taus[nmid++]);
+            evaluated[k] = 1;
+         }
+         double interpolated;
+         if (dnde[k] > 0 && dnde[k+1] > 0) {
+            interpolated = std::sqrt(dnde[k]*dnde[k+1]);
+         } else {
+            interpolated = dnde[k] + (dnde[k+1] - dnde[k])
+               *(midEnergy[k] - energy[k])/(energy[k+1] - energy[k]);
+         }
+         double width(midEnergy[k]*std::log(energy[k+1]/energy[k]));
+         errors[k] = std::fabs(interpolated - midDnde[k])*width;
+         total += midDnde[k]*width;
+         error += errors[k];
+      }
+      if (!(total > 0)) {
+         return;
+      }
+      if (error <= s_tolerance*total) {
+         break;
+      }
+      double share(s_tolerance*total/errors.size());
+      std::vector<double> newEnergy, newDnde, newMidEnergy, newMidDnde;
+      std::vector<char> newEvaluated;
+      for (size_t k = 0; k < errors.size(); k++) {
+         newEnergy.push_back(energy[k]);
+         newDnde.push_back(dnde[k]);
+         if (errors[k] > share) {
+            newEnergy.push_back(midEnergy[k]);
+            newDnde.push_back(midDnde[k]);
+            newMidEnergy.insert(newMidEnergy.end(), 2, 0.);
+            newMidDnde.insert(newMidDnde.end(), 2, 0.);
+            newEvaluated.insert(newEvaluated.end(), 2, 0);
+         } else {
+            newMidEnergy.push_back(midEnergy[k]);
+            newMidDnde.push_back(midDnde[k]);
+            newEvaluated.push_back(1);
+         }
+      }
+      newEnergy.push_back(energy.back());
+      newDnde.push_back(dnde.back());
+      if (newEnergy.size() > s_maxNodes) {
+         return;
+      }
+      energy.swap(newEnergy);
+      dnde.swap(newDnde);
+      midEnergy.swap(newMidEnergy);
+      midDnde.swap(newMidDnde);
+      evaluated.swap(newEvaluated);
+   }
+
+   nn = energy.size();
+   std::vector<double> table(4*nn);
+   std::copy(energy.begin(), energy.end(), table.begin());
+   std::copy(dnde.begin(), dnde.end(), table.begin() + nn);
+   double * cumulative = &table[2*nn];
+   double * index = cumulative + nn;
+   cumulative[0] = 0;
+   for (size_t k = 0; k < nn - 1; k++) {
+      double ratio(energy[k+1]/energy[k]);
+      double part;
+      if (dnde[k] > 0 && dnde[k+1] > 0) {
+         index[k] = std::log(dnde[k+1]/dnde[k])/std::log(ratio);
+         double aa(index[k] + 1.);
+         if (std::fabs(aa) > 1e-6) {
+            part = dnde[k]*energy[k]*(std::pow(ratio, aa) - 1.)/aa;
+         } else {
+            part = dnde[k]*energy[k]*std::log(ratio);
+         }
+      } else {
+// exp(-tau) has underflowed; use the trapezoid rule and draw
+// uniformly within the interval.
+         index[k] = 0;
+         part = 0.5*(dnde[k] + dnde[k+1])*(energy[k+1] - energy[k]);
+      }
+      cumulative[k+1] = cumulative[k] + part;
+   }
+   index[nn - 1] = 0;
+   if (!(cumulative[nn - 1] > 0)) {
+      return;
+   }
+   m_table.swap(table);
+}
+
+double SourcePopulation::
+PointSource::drawFromTable(double xi) const {
+   size_t nn(m_table.size()/4);
+   const double * energy = &m_table[0];
+   const double * dnde = energy + nn;
+   const double * cumulative = dnde + nn;
+   const double * index = cumulative + nn;
+   double target(xi*cumulative[nn - 1]);
+   size_t k = std::upper_bound(cumulative, cumulative + nn, target) 
+      - cumulative - 1;
+   k = std::min(k, nn - 2);
+   double part(target - cumulative[k]);
+   if (!(dnde[k] > 0 && dnde[k+1] > 0)) {
+      double frac(part/(cumulative[k+1] - cumulative[k]));
+      return energy[k] + frac*(energy[k+1] - energy[k]);
+   }
+// Invert the integral of dnde[k]*(E/energy[k])**index[k].
+   double aa(index[k] + 1.);
+   double scale(dnde[k]*energy[k]);
+   if (std::fabs(aa) > 1e-6) {
+      return energy[k]*std::pow(1. + part*aa/scale, 1./aa);
+   }
+   return energy[k]*std::exp(part/scale);
 }
 
 double SourcePopulation::
@@ -255,11 +666,17 @@ PointSource::dnde(double energy) const {
    return attenuation(energy)*std::pow(energy/m_ebreak, -gamma);
 }
 
+double SourcePopulation::
+PointSource::attenuatedDnde(double energy, float tau) const {
+   double gamma(energy < m_ebreak ? m_gamma : m_gamma2);
+   return std::exp(-tau)*std::pow(energy/m_ebreak, -gamma);
+}
+
 double SourcePopulation::
 PointSource::attenuation(double energy) const {
    double atten(1.);
-   if (s_tau != 0) {
-      atten = std::exp(-s_tau->operator()(energy, m_z));
+   if (m_tau != 0) {
+      atten = std::exp(-m_tau->operator()(energy, m_z));
    }
    return atten;
 }
@@ -200,20 +200,38 @@ void SpectralTransient::fillEventCache(double time) {
          if (m_logParabola) {
             m_currentInterval->fillCumulativeDist(m_emin, m_emax);
          }
-         for (int i = 0; i < nevts; i++) {
-            double energy;
-            if (m_specFile) {
-               energy = drawEnergy();
-            } else {
-               energy = m_currentInterval->drawEnergy(m_emin, m_emax);
-            }
-            if (m_z == 0 || m_tau == 0 || 
-                CLHEP::RandFlat::shoot() < std::exp(-m_tauScale*
-                                                    (*m_tau)(energy, m_z))) {
+         if (m_z == 0 || m_tau == 0) {
+            for (int i = 0; i < nevts; i++) {
+               double energy;
+               if (m_specFile) {
+                  energy = drawEnergy();
+               } else {
+                  energy = m_currentInterval->drawEnergy(m_emin, m_emax);
+               }
 //               double eventTime(CLHEP::RandFlat::shoot()*dt + time);
                double eventTime(::my_RandFlat_shoot()*dt + time);
                my_cache.push_back(std::make_pair(eventTime, energy));
             }
+         } else {
+// Draw all the energies of the interval first, so that the EBL optical
+// depths are computed at once.  The energies are kept in single precision,
+// like the arguments of EblAtten.
+            std::vector<float> energies(nevts);
+            for (int i = 0; i < nevts; i++) {
+               if (m_specFile) {
+                  energies[i] = drawEnergy();
+               } else {
+                  energies[i] = m_currentInterval->drawEnergy(m_emin, m_emax);
+               }
+            }
+            std::vector<float> taus;
+            (*m_tau)(energies, m_z, taus);
+            for (int i = 0; i < nevts; i++) {
+               if (CLHEP::RandFlat::shoot() < std::exp(-m_tauScale*taus[i])) {
+                  double eventTime(::my_RandFlat_shoot()*dt + time);
+                  my_cache.push_back(std::make_pair(eventTime, energies[i]));
+               }
+            }
          }
          if (m_logParabola) {
             m_currentInterval->clearCumulativeDist();
@@ -36,4 +36,7 @@ TF1Map::TF1Map(const std::string& params)
 
   if(m_flux==0.)
     m_flux = p_tf1.Integral(e_min,e_max);
+
+  //Scale as MapSource does for a sub-map or region of interest
+  m_flux *= m_fluxScale;
 }
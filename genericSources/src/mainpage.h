@@ -82,7 +82,11 @@
    - <b>flux</b> Total flux from the map, integrated over solid angle, in 
      units of \f$\mbox{m}^{-2}\mbox{s}^{-1}\f$.
    - <b>FITS file</b> A plate-carree FITS image in Galactic or J2000 
-     coordinates.
+     coordinates, or a HEALPix map (RING or NESTED) in a binary table.
+   - <b>emin, emax</b> Optional energy band in MeV, given as keywords,
+     e.g., params="flux=1, fitsFile=cube.fits, emin=1e4".  Only photons
+     in the band are produced, and the flux is reduced to that of the
+     map in the band.
 @verbatim
    <source name="map_cube_source">
       <spectrum escale="MeV">
@@ -99,9 +103,15 @@
    - <b>gamma</b> Photon spectral index such that 
       \f$dN/dE \propto E^{-\Gamma}\f$.
    - <b>FITS file</b> A plate-carree FITS image in Galactic or J2000 
-     coordinates.
+     coordinates, or a HEALPix map (RING or NESTED) in a binary table.
    - <b>Emin (30)</b> Minimum photon energy in MeV.
    - <b>Emax (1e5)</b> Maximum photon energy in MeV.
+   - <b>roiCone, roiPolygon, roiFrame</b> Optional region of interest,
+     given as keywords for both MapSource and MapCube, e.g.,
+     roiCone=83.63:22.01:15 or roiPolygon=lon1:lat1:lon2:lat2:lon3:lat3
+     in degrees, with roiFrame=equatorial (default) or galactic.  Only
+     the pixels with centres in the region are sampled, and the flux is
+     reduced to that of the region.
 @verbatim
 <!-- MapSource version of the Galactic Diffuse model -->
    <source name="Galactic_diffuse">
@@ -190,6 +200,10 @@
    - <b>Emax (2e5)</b> Maximum photon energy in MeV.
    - <b>lc (0)</b> light curve number, if FITS file.
    - <b>z (0)</b> Redshift used for EBL attenuation calculation.
+     For z > 0, the energies of all the events of a light curve interval
+     are drawn before their arrival times, so that the optical depths are
+     computed at once; seeded runs of such sources give different events
+     than earlier versions.
    - <b>useLogParabola (0)</b> Flag to use log-parabolic form for the
      spectrum rather than a broken power-law
 @verbatim
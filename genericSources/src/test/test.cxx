@@ -10,11 +10,21 @@
 #endif
 
 #include <cmath>
+#include <cstdio>
 #include <cstdlib>
 
+#include <algorithm>
 #include <fstream>
+#include <memory>
 #include <sstream>
 
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CLHEP/Random/Random.h"
+#include "CLHEP/Random/RandFlat.h"
+
 #include "astro/GPS.h"
 #include "astro/PointingTransform.h"
 #include "astro/SkyDir.h"
@@ -24,9 +34,19 @@
 
 #include "facilities/commonUtilities.h"
 
+#include "eblAtten/EblAtten.h"
+
+#include "genericSources/FileSpectrumMap.h"
+#include "genericSources/MapCube.h"
+#include "genericSources/MapSource.h"
 #include "genericSources/SourcePopulation.h"
+#ifndef BUILD_WITHOUT_ROOT
+#include "genericSources/TF1Map.h"
+#endif
 
 #include "GaussianQuadrature.h"
+#include "HealpixImage.h"
+#include "SkyRegion.h"
 
 #include "TestUtil.h"
 
@@ -75,6 +95,13 @@ public:
    void createEvents(const std::string & filename);
 
    void test_dgaus8() const;
+   void test_sourcePopulation() const;
+   void test_attenuatedSpectrum() const;
+   void test_pixelSamplers() const;
+   void test_mapIndex() const;
+   void test_healpixPixels() const;
+   void test_skyRegion() const;
+   void test_regionFlux() const;
 
    static void load_sources();
    static CLHEP::HepRotation instrumentToCelestial(double time);
@@ -97,6 +124,13 @@ int main(int iargc, char * argv[]) {
       TestApp testApp;
       
       testApp.test_dgaus8();
+      testApp.test_sourcePopulation();
+      testApp.test_attenuatedSpectrum();
+      testApp.test_pixelSamplers();
+      testApp.test_mapIndex();
+      testApp.test_healpixPixels();
+      testApp.test_skyRegion();
+      testApp.test_regionFlux();
 
       testApp.parseCommandLine(iargc, argv);
       testApp.load_sources();
@@ -277,3 +311,435 @@ void TestApp::test_dgaus8() const {
       throw std::runtime_error(message.str());
    }
 }
+
+void TestApp::test_sourcePopulation() const {
+// The binary version of a catalog should give the same sources as the
+// ascii version.
+   std::string catalog(facilities::commonUtilities::joinPath(
+      facilities::commonUtilities::getDataPath("genericSources"),
+      "sourcePop.dat"));
+   std::string binaryCatalog("sourcePop_test.bin");
+   SourcePopulation::writeBinaryCatalog(catalog, binaryCatalog);
+   SourcePopulation ascii(catalog);
+   SourcePopulation binary(binaryCatalog);
+   if (ascii.flux(0) != binary.flux(0)) {
+      throw std::runtime_error("test_sourcePopulation failed: "
+                               "total fluxes differ");
+   }
+   for (size_t i = 0; i < 100; i++) {
+      float xi((i + 0.5)/100.);
+      CLHEP::HepRandom::setTheSeed(i + 1);
+      double energy(ascii(xi));
+      CLHEP::HepRandom::setTheSeed(i + 1);
+      if (energy != binary(xi) || ascii.name() != binary.name()) {
+         throw std::runtime_error("test_sourcePopulation failed: "
+                                  "ascii and binary catalogs differ");
+      }
+   }
+   std::remove(binaryCatalog.c_str());
+}
+
+class AttenuatedSpectrum {
+public:
+   AttenuatedSpectrum(double gamma, double gamma2, double ebreak, double zz,
+                      const IRB::EblAtten & tau)
+      : m_gamma(gamma), m_gamma2(gamma2), m_ebreak(ebreak), m_z(zz),
+        m_tau(tau) {}
+   double operator()(double energy) const {
+      double gamma(energy < m_ebreak ? m_gamma : m_gamma2);
+      return std::exp(-m_tau(energy, m_z))*std::pow(energy/m_ebreak, -gamma);
+   }
+private:
+   double m_gamma;
+   double m_gamma2;
+   double m_ebreak;
+   double m_z;
+   const IRB::EblAtten & m_tau;
+};
+
+void TestApp::test_attenuatedSpectrum() const {
+// After enough rejections, the energies of an attenuated source are drawn
+// from a table whose cumulative distribution is good to 1e-3.  Compare
+// the draws with the cumulative distribution of the actual spectrum.
+   std::string catalog("sourcePop_ebl_test.dat");
+   std::ofstream output(catalog.c_str());
+   output << "src0  0  0  1  1.8  2.4  1e4  1e3  2e5  2\n";
+   output.close();
+   SourcePopulation population(catalog + ",0");
+   std::remove(catalog.c_str());
+
+   size_t ndraws(1000000);
+   std::vector<double> energies(ndraws);
+   CLHEP::HepRandom::setTheSeed(1);
+   for (size_t i = 0; i < ndraws; i++) {
+      energies[i] = population.energy(0);
+   }
+   std::sort(energies.begin(), energies.end());
+
+   IRB::EblAtten tau(IRB::Kneiske);
+   AttenuatedSpectrum dnde(1.8, 2.4, 1e4, 2, tau);
+   size_t npts(101);
+   std::vector<double> grid(npts);
+   for (size_t k = 0; k < npts; k++) {
+      grid[k] = 1e3*std::pow(200., double(k)/(npts - 1));
+   }
+   std::vector<double> cumulative(npts, 0);
+   for (size_t k = 1; k < npts; k++) {
+      double err(1e-6);
+      int ier;
+      double part(0);
+      if (grid[k-1] < 1e4 && grid[k] > 1e4) {
+         part = genericSources::GaussianQuadrature::dgaus8(dnde, grid[k-1],
+                                                           1e4, err, ier)
+            + genericSources::GaussianQuadrature::dgaus8(dnde, 1e4, grid[k],
+                                                         err, ier);
+      } else {
+         part = genericSources::GaussianQuadrature::dgaus8(dnde, grid[k-1],
+                                                           grid[k], err, ier);
+      }
+      cumulative[k] = cumulative[k-1] + part;
+   }
+// Kolmogorov-Smirnov distance at the grid points; 1.95/sqrt(N) is the
+// 0.1% critical value.
+   double maxdiff(0);
+   for (size_t k = 0; k < npts; k++) {
+      double fraction = double(std::upper_bound(energies.begin(),
+                                                energies.end(), grid[k])
+                               - energies.begin())/ndraws;
+      maxdiff = std::max(maxdiff,
+                         std::fabs(fraction - cumulative[k]/cumulative.back()));
+   }
+   if (maxdiff > 1e-3 + 1.95/std::sqrt(double(ndraws))) {
+      std::ostringstream message;
+      message << "test_attenuatedSpectrum failed: "
+              << "cumulative distributions differ by " << maxdiff;
+      throw std::runtime_error(message.str());
+   }
+}
+
+class TestMapSource : public MapSource {
+public:
+   TestMapSource(const std::vector<double> & solidAngles,
+                 const std::vector<double> & pixelValues,
+                 const std::string & sampler, long nside=0) {
+      m_solidAngles = solidAngles;
+      m_nside = nside;
+      setPixelSampler(sampler);
+      makeIntegralDistribution(pixelValues);
+   }
+   unsigned int pixel() const {
+      return drawPixel(CLHEP::RandFlat::shoot());
+   }
+};
+
+void TestApp::test_pixelSamplers() const {
+// Each of the pixel samplers should draw the pixels in proportion to
+// solid angle times intensity, leaving out the first pixel of a
+// plate-carree image but not of a HEALPix map.  The map spans several
+// tiles of the tile sampler, and one of them is empty.
+   long nside(32);
+   size_t npix(12*nside*nside);
+   std::vector<double> solidAngles(npix), pixelValues(npix);
+   for (size_t i = 0; i < npix; i++) {
+      solidAngles[i] = 1e-4*(1. + 0.5*std::sin(0.01*i));
+      pixelValues[i] = (i % 100 == 0) ? 20. : std::exp(-double(i % 250)/50.);
+      if (i >= 5000 && i < 9000) {
+         pixelValues[i] = 0;
+      }
+   }
+   const char * samplers[] = {"search", "alias", "tiles"};
+   size_t ndraws(1000000);
+   for (size_t healpix = 0; healpix < 2; healpix++) {
+      size_t first(healpix ? 0 : 1);
+      std::vector<double> expected(npix, 0);
+      double total(0);
+      for (size_t i = first; i < npix; i++) {
+         expected[i] = solidAngles[i]*pixelValues[i];
+         total += expected[i];
+      }
+      for (size_t k = 0; k < sizeof(samplers)/sizeof(samplers[0]); k++) {
+         TestMapSource source(solidAngles, pixelValues, samplers[k],
+                              healpix ? nside : 0);
+         CLHEP::HepRandom::setTheSeed(k + 1);
+         std::vector<double> counts(npix, 0);
+         for (size_t j = 0; j < ndraws; j++) {
+            counts.at(source.pixel())++;
+         }
+         if (first == 1 && counts[0] != 0) {
+            throw std::runtime_error(std::string("test_pixelSamplers failed: ")
+                                     + samplers[k] + " draws the first pixel"
+                                     + " of a plate-carree image");
+         }
+// chi^2 for the pixels with non-zero weights, allowing for 5 sigma.
+         double chi2(0);
+         size_t ndof(0);
+         for (size_t i = first; i < npix; i++) {
+            double mean(expected[i]/total*ndraws);
+            if (mean == 0) {
+               if (counts[i] != 0) {
+                  throw std::runtime_error(std::string("test_pixelSamplers ")
+                                           + "failed: " + samplers[k]
+                                           + " draws an empty pixel");
+               }
+               continue;
+            }
+            chi2 += (counts[i] - mean)*(counts[i] - mean)/mean;
+            ndof++;
+         }
+         ndof--;
+         if (chi2 > ndof + 5.*std::sqrt(2.*ndof)) {
+            std::ostringstream message;
+            message << "test_pixelSamplers failed: " << samplers[k]
+                    << " pixel frequencies have chi^2 = " << chi2
+                    << " for " << ndof << " degrees of freedom";
+            throw std::runtime_error(message.str());
+         }
+      }
+   }
+}
+
+namespace {
+   Spectrum * makeMapSource(const std::string & className,
+                            const std::string & params) {
+      if (className == "MapCube") {
+         return new MapCube(params);
+      }
+      return new MapSource(params);
+   }
+
+   void drawPhotons(Spectrum & source, size_t ndraws,
+                    std::vector<double> & photons) {
+      CLHEP::HepRandom::setTheSeed(1);
+      photons.clear();
+      for (size_t i = 0; i < ndraws; i++) {
+         double energy(source.energy(0));
+         std::pair<double, double> dir(source.dir(energy));
+         photons.push_back(energy);
+         photons.push_back(dir.first);
+         photons.push_back(dir.second);
+      }
+   }
+
+   void shortenLastSections(const std::string & indexDir) {
+// Index files start with an 8-byte magic string, two 4-byte integers
+// giving the byte order and the number of sections, and the sizes of
+// the sections as 8-byte integers.  Take 8 bytes off the size of the
+// last section, which leaves the key and the file readable.
+      DIR * dir(opendir(indexDir.c_str()));
+      if (dir == 0) {
+         return;
+      }
+      while (struct dirent * entry = readdir(dir)) {
+         std::string name(entry->d_name);
+         if (name == "." || name == "..") {
+            continue;
+         }
+         std::string path(facilities::commonUtilities::joinPath(indexDir,
+                                                                name));
+         std::fstream file(path.c_str(), std::ios::in | std::ios::out
+                           | std::ios::binary);
+         unsigned int nsections;
+         file.seekg(12);
+         file.read(reinterpret_cast<char *>(&nsections), sizeof(nsections));
+         unsigned long long size;
+         std::streamoff position(16 + 8*(nsections - 1));
+         file.seekg(position);
+         file.read(reinterpret_cast<char *>(&size), sizeof(size));
+         if (file && size >= 8) {
+            size -= 8;
+            file.seekp(position);
+            file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+         }
+      }
+      closedir(dir);
+   }
+}
+
+void TestApp::test_mapIndex() const {
+// Sources built from saved index files should draw the same photons as
+// those built from the FITS files, for each pixel sampler.
+   std::string dataPath(facilities::commonUtilities::getDataPath("genericSources"));
+   std::string image(facilities::commonUtilities::joinPath(dataPath,
+                                                           "test_image.fits"));
+   std::string cube(facilities::commonUtilities::joinPath(dataPath,
+                                                          "map_cube_example.fits"));
+   std::vector< std::pair<std::string, std::string> > sources;
+   sources.push_back(std::make_pair("MapSource", "flux=1,fitsFile=" + image
+                                    + ",pixelSampler=search"));
+   sources.push_back(std::make_pair("MapSource", "flux=1,fitsFile=" + image
+                                    + ",pixelSampler=alias"));
+   sources.push_back(std::make_pair("MapSource", "flux=1,fitsFile=" + image
+                                    + ",pixelSampler=tiles"));
+   sources.push_back(std::make_pair("MapCube", "flux=1,fitsFile=" + cube));
+
+   std::string indexDir("mapIndex_test");
+   mkdir(indexDir.c_str(), 0755);
+   size_t ndraws(1000);
+   for (size_t k = 0; k < sources.size(); k++) {
+      const std::string & className(sources[k].first);
+      const std::string & params(sources[k].second);
+      unsetenv("GENERICSOURCES_MAP_INDEX");
+      std::unique_ptr<Spectrum> fromFits(makeMapSource(className, params));
+      setenv("GENERICSOURCES_MAP_INDEX", indexDir.c_str(), 1);
+      std::unique_ptr<Spectrum> saved(makeMapSource(className, params));
+      std::unique_ptr<Spectrum> fromIndex(makeMapSource(className, params));
+      std::vector<double> expected, photons;
+      drawPhotons(*fromFits, ndraws, expected);
+      drawPhotons(*fromIndex, ndraws, photons);
+      if (photons != expected
+          || fromIndex->flux(0) != fromFits->flux(0)) {
+         throw std::runtime_error("test_mapIndex failed: " + className
+                                  + " from the index differs for " + params);
+      }
+// An index whose sampling table or spectra are too short should be
+// ignored, and the tables rebuilt from the FITS file.
+      saved.reset();
+      fromIndex.reset();
+      shortenLastSections(indexDir);
+      std::unique_ptr<Spectrum> rebuilt(makeMapSource(className, params));
+      drawPhotons(*rebuilt, ndraws, photons);
+      if (photons != expected || rebuilt->flux(0) != fromFits->flux(0)) {
+         throw std::runtime_error("test_mapIndex failed: " + className
+                                  + " from a short index differs for "
+                                  + params);
+      }
+   }
+   unsetenv("GENERICSOURCES_MAP_INDEX");
+
+// Each source should have saved one index file.
+   size_t nfiles(0);
+   DIR * dir(opendir(indexDir.c_str()));
+   if (dir != 0) {
+      while (struct dirent * entry = readdir(dir)) {
+         std::string name(entry->d_name);
+         if (name != "." && name != "..") {
+            std::remove(facilities::commonUtilities::joinPath(indexDir,
+                                                              name).c_str());
+            nfiles++;
+         }
+      }
+      closedir(dir);
+   }
+   rmdir(indexDir.c_str());
+   if (nfiles != sources.size()) {
+      std::ostringstream message;
+      message << "test_mapIndex failed: " << nfiles
+              << " index files were written for " << sources.size()
+              << " sources";
+      throw std::runtime_error(message.str());
+   }
+}
+
+void TestApp::test_healpixPixels() const {
+// Pixel centres for NSIDE = 4 in the RING and NESTED schemes, from the
+// HEALPix pix2ang_ring and pix2ang_nest algorithms.
+   struct Reference {
+      bool nested;
+      long long pixel;
+      double lon;
+      double lat;
+   };
+   const Reference refs[] = {{false, 0, 45., 78.28414760510762},
+                             {false, 23, 345., 54.34091230386124},
+                             {false, 24, 11.25, 41.81031489577859},
+                             {false, 90, 56.25, 0.},
+                             {false, 167, 348.75, -41.81031489577862},
+                             {false, 191, 315., -78.28414760510762},
+                             {true, 0, 45., 9.594068226860458},
+                             {true, 13, 67.5, 66.44353569089877},
+                             {true, 63, 315., 78.28414760510762},
+                             {true, 100, 202.5, -9.594068226860458},
+                             {true, 150, 146.25, -41.81031489577862},
+                             {true, 191, 315., -9.594068226860458}};
+   for (size_t i = 0; i < sizeof(refs)/sizeof(refs[0]); i++) {
+      double lon, lat;
+      genericSources::HealpixImage::pixelDirection(4, refs[i].nested,
+                                                   refs[i].pixel, 0.5, 0.5,
+                                                   lon, lat);
+      double dlon(std::fmod(lon - refs[i].lon + 540., 360.) - 180.);
+      if (std::fabs(dlon) > 1e-9 || std::fabs(lat - refs[i].lat) > 1e-9) {
+         std::ostringstream message;
+         message << "test_healpixPixels failed: "
+                 << (refs[i].nested ? "NESTED" : "RING") << " pixel "
+                 << refs[i].pixel << " is at (" << lon << ", " << lat
+                 << "), not (" << refs[i].lon << ", " << refs[i].lat << ")";
+         throw std::runtime_error(message.str());
+      }
+   }
+}
+
+void TestApp::test_skyRegion() const {
+   genericSources::SkyRegion region(astro::SkyDir::EQUATORIAL);
+   std::vector<double> vertices;
+// An L-shaped polygon about (83.6, 22), with its notch to the north-east.
+   double corners[] = {78.6, 17., 88.6, 17., 88.6, 22., 83.6, 22.,
+                       83.6, 27., 78.6, 27.};
+   vertices.assign(corners, corners + sizeof(corners)/sizeof(corners[0]));
+   region.setPolygon(vertices);
+   region.setCoordSys(astro::SkyDir::EQUATORIAL);
+   if (!region.contains(81., 19.5) || !region.contains(86., 19.5)
+       || !region.contains(81., 24.5)) {
+      throw std::runtime_error("test_skyRegion failed: "
+                               "interior point is outside the polygon");
+   }
+   if (region.contains(86., 24.5) || region.contains(100., 22.)
+       || region.contains(81., 40.)) {
+      throw std::runtime_error("test_skyRegion failed: "
+                               "exterior point is inside the polygon");
+   }
+// The antipodes of interior points are outside.
+   if (region.contains(261., -19.5) || region.contains(266., -19.5)
+       || region.contains(261., -24.5)) {
+      throw std::runtime_error("test_skyRegion failed: "
+                               "antipode of an interior point is inside "
+                               "the polygon");
+   }
+   region.setCone(81., 19.5, 2.);
+   region.setCoordSys(astro::SkyDir::EQUATORIAL);
+   if (!region.contains(81., 20.5) || region.contains(86., 19.5)
+       || region.contains(261., -19.5)) {
+      throw std::runtime_error("test_skyRegion failed: "
+                               "wrong intersection of cone and polygon");
+   }
+}
+
+void TestApp::test_regionFlux() const {
+// A region of interest should scale the flux of each kind of map
+// source by the same share of the map integral.
+   std::string dataPath(facilities::commonUtilities::getDataPath("genericSources"));
+   std::string params("flux=17.,fitsFile="
+                      + facilities::commonUtilities::joinPath(dataPath,
+                                                              "test_image.fits")
+                      + ",emin=100.,emax=1000.");
+   std::string roi(",roiCone=266:-29:5");
+   MapSource whole(params);
+   MapSource cut(params + roi);
+   double scale(cut.flux(0)/whole.flux(0));
+   if (!(scale > 0 && scale < 1)) {
+      throw std::runtime_error("test_regionFlux failed: "
+                               "the region does not scale the MapSource flux");
+   }
+   std::vector< std::pair<std::string, double> > ratios;
+   std::string specFile(",specFile="
+                        + facilities::commonUtilities::joinPath(dataPath,
+                                                                "dm120gev.dat"));
+   FileSpectrumMap fileWhole(params + specFile);
+   FileSpectrumMap fileCut(params + specFile + roi);
+   ratios.push_back(std::make_pair("FileSpectrumMap",
+                                   fileCut.flux(0)/fileWhole.flux(0)));
+#ifndef BUILD_WITHOUT_ROOT
+   std::string formula(",formula=-0.0001*(100.-x)*(1100.-x),tf1precision=100");
+   TF1Map tf1Whole(params + formula + ",tf1name=TF1Map_whole");
+   TF1Map tf1Cut(params + formula + ",tf1name=TF1Map_cut" + roi);
+   ratios.push_back(std::make_pair("TF1Map", tf1Cut.flux(0)/tf1Whole.flux(0)));
+#endif
+   for (size_t i = 0; i < ratios.size(); i++) {
+      if (std::fabs(ratios[i].second - scale) > 1e-12*scale) {
+         std::ostringstream message;
+         message << "test_regionFlux failed: the region scales the "
+                 << ratios[i].first << " flux by " << ratios[i].second
+                 << " rather than " << scale;
+         throw std::runtime_error(message.str());
+      }
+   }
+}